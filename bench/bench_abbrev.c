@@ -0,0 +1,124 @@
+// Resolving abbreviations through tz_abbrev_offset against scanning every zone with tz_lookup
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_abbrev.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+#define LOOKUP_COUNT 1000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *names[] = {"EST", "EDT", "CST", "CDT", "PST", "PDT", "CET", "CEST", "BST", "MSK", "IST", "JST", "AEST", "UTC", "GMT", "HKT"};
+#define NAME_COUNT ((int)(sizeof(names) / sizeof(names[0])))
+
+int main(void) {
+	TZ_Zone_Index *zone_index;
+	if (!tz_zone_index_build(NULL, &zone_index)) {
+		fprintf(stderr, "failed to build the zone index\n");
+		return 1;
+	}
+
+	int32_t zone_count = tz_zone_index_count(zone_index);
+	TZ_Region **zones = (TZ_Region **)calloc(zone_count, sizeof(TZ_Region *));
+	int32_t loaded = 0;
+	for (int32_t i = 0; i < zone_count; i++) {
+		if (tz_region_load(tz_zone_index_name(zone_index, i), &zones[loaded])) {
+			loaded += 1;
+		}
+	}
+	if (loaded == 0) {
+		fprintf(stderr, "no zones could be loaded\n");
+		return 1;
+	}
+
+	double begin = now_ns();
+	TZ_Abbrev_Index *index;
+	if (!tz_abbrev_index_build(zones, loaded, &index)) {
+		fprintf(stderr, "failed to build the abbreviation index\n");
+		return 1;
+	}
+	double build_ns = now_ns() - begin;
+
+	int64_t start = 1735689600; // 2025-01-01
+	int64_t sink = 0;
+
+	// The naive way: the first zone using the name right now
+	begin = now_ns();
+	for (int j = 0; j < LOOKUP_COUNT / 1000; j++) {
+		char *name = names[j % NAME_COUNT];
+		for (int32_t i = 0; i < loaded; i++) {
+			TZ_Lookup span;
+			tz_lookup(zones[i], start + j, &span);
+			if (strcasecmp(span.shortname, name) == 0) {
+				sink += span.utc_offset;
+				break;
+			}
+		}
+	}
+	double scan_ns = (now_ns() - begin) / (LOOKUP_COUNT / 1000);
+
+	begin = now_ns();
+	for (int j = 0; j < LOOKUP_COUNT; j++) {
+		char *name = names[j % NAME_COUNT];
+		int64_t offset;
+		bool dst;
+		if (tz_abbrev_offset(index, name, (int)strlen(name), start + j, &offset, &dst)) {
+			sink += offset;
+		}
+	}
+	double index_ns = (now_ns() - begin) / LOOKUP_COUNT;
+
+	// Whatever name a zone shows at some instant has to come back as a candidate with its offset
+	int64_t checked = 0;
+	int64_t mismatches = 0;
+	TZ_Abbrev_Match matches[64];
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (int j = 0; j < 200000; j++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		int32_t zone = (int32_t)(x % loaded);
+		int64_t t = -2208988800ll + (int64_t)((x >> 16) % 6000000000ull);
+		TZ_Lookup span;
+		tz_lookup(zones[zone], t, &span);
+		if (span.shortname[0] == '\0') {
+			continue;
+		}
+
+		int64_t found = tz_abbrev_candidates(index, span.shortname, (int)strlen(span.shortname), t, matches, 64);
+		bool hit = false;
+		for (int64_t i = 0; i < found && i < 64; i++) {
+			hit |= matches[i].zone == zone && matches[i].utc_offset == span.utc_offset && matches[i].dst == span.dst;
+		}
+		mismatches += !hit;
+		checked += 1;
+	}
+
+	printf("%d zones, index built in %.2f ms\n", loaded, build_ns / 1e6);
+	printf("scanning every zone: %10.1f ns/lookup\n", scan_ns);
+	printf("tz_abbrev_offset:    %10.1f ns/lookup\n", index_ns);
+	for (int i = 0; i < NAME_COUNT; i++) {
+		int64_t offset;
+		bool dst;
+		if (tz_abbrev_offset(index, names[i], (int)strlen(names[i]), start, &offset, &dst)) {
+			printf("  %-5s %+6lld%s\n", names[i], (long long)offset, dst ? " dst" : "");
+		}
+	}
+	printf("mismatches: %lld of %lld  (%lld)\n", (long long)mismatches, (long long)checked, (long long)(sink & 0xF));
+
+	tz_abbrev_index_destroy(index);
+	for (int32_t i = 0; i < loaded; i++) {
+		tz_region_destroy(zones[i]);
+	}
+	free(zones);
+	tz_zone_index_destroy(zone_index);
+	return mismatches != 0;
+}
@@ -0,0 +1,86 @@
+// Adding a month to every date in a schedule: by hand through tz_get_date and
+// tz_time_from_components, against tz_add and tz_add_batch
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_calendar.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+#define DATE_COUNT 1000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(void) {
+	TZ_Region *tz;
+	if (!tz_region_load("America/New_York", &tz)) {
+		fprintf(stderr, "failed to load America/New_York\n");
+		return 1;
+	}
+
+	// Payment dates an hour apart from 2025 on, as wall-clock times
+	int64_t *local = (int64_t *)malloc(DATE_COUNT * sizeof(int64_t));
+	int64_t *by_hand = (int64_t *)malloc(DATE_COUNT * sizeof(int64_t));
+	int64_t *single = (int64_t *)malloc(DATE_COUNT * sizeof(int64_t));
+	int64_t *batch = (int64_t *)malloc(DATE_COUNT * sizeof(int64_t));
+	TZ_Time start = tz_time_from_components((TZ_Date){.year = 2025, .month = 1, .day = 1}, (TZ_HMS){.hours = 9}, tz);
+	for (int64_t i = 0; i < DATE_COUNT; i++) {
+		local[i] = start.time + (i * 3600);
+	}
+
+	TZ_Period month = {.months = 1};
+	TZ_Resolve_Policy policy = {.fold = TZ_Fold_Earlier, .gap = TZ_Gap_Shift_Forward};
+
+	double begin = now_ns();
+	for (int64_t i = 0; i < DATE_COUNT; i++) {
+		TZ_Time t = {.time = local[i], .tz = tz};
+		TZ_Date date = tz_get_date(t);
+		TZ_HMS hms = tz_get_hms(t);
+		date.year += date.month / 12;
+		date.month = (int8_t)((date.month % 12) + 1);
+		TZ_Time next = tz_time_from_components(date, hms, tz);
+		by_hand[i] = tz_time_to_tz(tz_time_to_utc(next), tz).time;
+	}
+	double by_hand_ns = (now_ns() - begin) / DATE_COUNT;
+
+	begin = now_ns();
+	for (int64_t i = 0; i < DATE_COUNT; i++) {
+		TZ_Time out = {0};
+		tz_add((TZ_Time){.time = local[i], .tz = tz}, month, policy, &out);
+		single[i] = out.time;
+	}
+	double single_ns = (now_ns() - begin) / DATE_COUNT;
+
+	begin = now_ns();
+	int64_t failed = tz_add_batch(tz, local, month, policy, batch, DATE_COUNT);
+	double batch_ns = (now_ns() - begin) / DATE_COUNT;
+
+	// By hand overflows short months (Jan 31 + 1 month is March 3rd) and lands
+	// gap times wherever the offset guess puts them; count those separately
+	int64_t mismatches = failed;
+	int64_t by_hand_differs = 0;
+	for (int64_t i = 0; i < DATE_COUNT; i++) {
+		mismatches += single[i] != batch[i];
+		by_hand_differs += by_hand[i] != batch[i];
+	}
+
+	printf("%d dates + 1 month\n", DATE_COUNT);
+	printf("by hand:      %8.1f ns/date\n", by_hand_ns);
+	printf("tz_add:       %8.1f ns/date\n", single_ns);
+	printf("tz_add_batch: %8.1f ns/date\n", batch_ns);
+	printf("by hand differs on %lld dates\n", (long long)by_hand_differs);
+	printf("mismatches: %lld\n", (long long)mismatches);
+
+	free(local);
+	free(by_hand);
+	free(single);
+	free(batch);
+	tz_region_destroy(tz);
+	return mismatches != 0;
+}
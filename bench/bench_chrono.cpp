@@ -0,0 +1,88 @@
+// Initialization and lookup cost of libtz.hpp against the standard library's chrono tzdb
+// Build with bench/build.sh, or: clang++ -std=c++20 -O2 bench/bench_chrono.cpp libtz.c
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "../libtz.hpp"
+
+namespace chrono = std::chrono;
+
+static double elapsed_ns(chrono::steady_clock::time_point start) {
+	return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<chrono::sys_seconds> make_times(size_t count) {
+	std::vector<chrono::sys_seconds> times(count);
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i < count; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		// Somewhere between 1970 and 2070
+		times[i] = chrono::sys_seconds{chrono::seconds{(int64_t)(x % 3155760000ull)}};
+	}
+	return times;
+}
+
+template <class Zone>
+static void bench_lookups(const char *label, const Zone *zone, const std::vector<chrono::sys_seconds> &times) {
+	int64_t sink = 0;
+
+	auto start = chrono::steady_clock::now();
+	for (auto t : times) {
+		sink += zone->to_local(t).time_since_epoch().count();
+	}
+	double to_local_ns = elapsed_ns(start) / (double)times.size();
+
+	start = chrono::steady_clock::now();
+	for (auto t : times) {
+		auto local = chrono::local_seconds{t.time_since_epoch()};
+		sink += zone->to_sys(local, libtz::choose::earliest).time_since_epoch().count();
+	}
+	double to_sys_ns = elapsed_ns(start) / (double)times.size();
+
+	printf("%-24s to_local %7.1f ns   to_sys %7.1f ns   (%lld)\n", label, to_local_ns, to_sys_ns, (long long)(sink & 0xF));
+}
+
+int main(void) {
+	const char *zone_name = "America/New_York";
+
+	auto start = chrono::steady_clock::now();
+	const libtz::time_zone *zone = libtz::locate_zone(zone_name);
+	printf("libtz first locate_zone:  %10.0f ns\n", elapsed_ns(start));
+
+	start = chrono::steady_clock::now();
+	libtz::locate_zone(zone_name);
+	printf("libtz cached locate_zone: %10.0f ns\n", elapsed_ns(start));
+
+#if defined(LIBTZ_STD_TZDB)
+	start = chrono::steady_clock::now();
+	const chrono::time_zone *std_zone = chrono::locate_zone(zone_name);
+	printf("std first locate_zone:    %10.0f ns\n", elapsed_ns(start));
+
+	start = chrono::steady_clock::now();
+	chrono::locate_zone(zone_name);
+	printf("std cached locate_zone:   %10.0f ns\n", elapsed_ns(start));
+#endif
+
+	std::vector<chrono::sys_seconds> random_times = make_times(1 << 20);
+	std::vector<chrono::sys_seconds> sorted_times(1 << 20);
+	for (size_t i = 0; i < sorted_times.size(); i++) {
+		sorted_times[i] = chrono::sys_seconds{chrono::seconds{1700000000 + (int64_t)i * 30}};
+	}
+
+	bench_lookups("libtz random", zone, random_times);
+	bench_lookups("libtz sorted", zone, sorted_times);
+#if defined(LIBTZ_STD_TZDB)
+	bench_lookups("std random", std_zone, random_times);
+	bench_lookups("std sorted", std_zone, sorted_times);
+#endif
+
+	static constexpr libtz::fixed_zone ist{chrono::hours{5} + chrono::minutes{30}};
+	static_assert(ist.name() == "+05:30");
+	static_assert(ist.to_local(chrono::sys_seconds{chrono::seconds{0}}).time_since_epoch().count() == 19800);
+	bench_lookups("libtz fixed_zone", &ist, random_times);
+
+	return 0;
+}
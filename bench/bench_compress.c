@@ -0,0 +1,91 @@
+// Memory and lookup cost of tz_region_compress against the plain record table
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_compress.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+#define LOOKUP_COUNT 20000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double time_lookups(TZ_Region **regions, int32_t count, int64_t *times, int32_t *picks, int64_t *sink) {
+	double start = now_ns();
+	for (int64_t i = 0; i < LOOKUP_COUNT; i++) {
+		TZ_Lookup span;
+		tz_lookup(regions[picks[i]], times[i], &span);
+		*sink += span.utc_offset + span.valid_from;
+	}
+	return (now_ns() - start) / LOOKUP_COUNT;
+}
+
+int main(void) {
+	TZ_Zone_Index *index;
+	if (!tz_zone_index_build(NULL, &index)) {
+		fprintf(stderr, "failed to build the zone index\n");
+		return 1;
+	}
+
+	int32_t zone_count = tz_zone_index_count(index);
+	TZ_Region **plain = (TZ_Region **)calloc(zone_count, sizeof(TZ_Region *));
+	TZ_Region **packed = (TZ_Region **)calloc(zone_count, sizeof(TZ_Region *));
+	int32_t loaded = 0;
+	size_t plain_bytes = 0;
+	size_t packed_bytes = 0;
+	int64_t transitions = 0;
+	for (int32_t i = 0; i < zone_count; i++) {
+		char *name = tz_zone_index_name(index, i);
+		if (!tz_region_load(name, &plain[loaded]) || !tz_region_load(name, &packed[loaded]) || plain[loaded] == NULL) {
+			continue;
+		}
+
+		plain_bytes += tz_region_table_size(plain[loaded]);
+		transitions += plain[loaded]->record_count;
+		tz_region_compress(packed[loaded]);
+		packed_bytes += tz_region_table_size(packed[loaded]);
+		loaded += 1;
+	}
+
+	// Every zone, at times between 1900 and 2037 where the tables apply
+	int64_t *times = (int64_t *)malloc(LOOKUP_COUNT * sizeof(int64_t));
+	int32_t *picks = (int32_t *)malloc(LOOKUP_COUNT * sizeof(int32_t));
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (int64_t i = 0; i < LOOKUP_COUNT; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		times[i] = -2208988800ll + (int64_t)(x % 4354000000ull);
+		picks[i] = (int32_t)((x >> 40) % (uint64_t)loaded);
+	}
+
+	int64_t mismatches = 0;
+	for (int64_t i = 0; i < LOOKUP_COUNT; i += 7) {
+		TZ_Lookup a, b;
+		tz_lookup(plain[picks[i]], times[i], &a);
+		tz_lookup(packed[picks[i]], times[i], &b);
+		mismatches += a.utc_offset != b.utc_offset || a.dst != b.dst || strcmp(a.shortname, b.shortname) != 0 ||
+			a.valid_from != b.valid_from || a.valid_until != b.valid_until;
+	}
+
+	int64_t sink = 0;
+	double plain_ns = time_lookups(plain, loaded, times, picks, &sink);
+	double packed_ns = time_lookups(packed, loaded, times, picks, &sink);
+
+	printf("%d zones, %lld transitions\n", loaded, (long long)transitions);
+	printf("records: %8zu bytes (%5.2f per transition)  %6.1f ns/lookup\n", plain_bytes, (double)plain_bytes / (double)transitions, plain_ns);
+	printf("blocks:  %8zu bytes (%5.2f per transition)  %6.1f ns/lookup\n", packed_bytes, (double)packed_bytes / (double)transitions, packed_ns);
+	printf("mismatches: %lld  (%lld)\n", (long long)mismatches, (long long)(sink & 0xF));
+
+	for (int32_t i = 0; i < loaded; i++) {
+		tz_region_destroy(plain[i]);
+		tz_region_destroy(packed[i]);
+	}
+	tz_zone_index_destroy(index);
+	return mismatches != 0;
+}
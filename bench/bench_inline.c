@@ -0,0 +1,59 @@
+// Conversion and decomposition loops, linked against libtz.o or built with
+// LIBTZ_STATIC so the library is inlined into them
+// Build with bench/build.sh, which makes both bench_inline and bench_inline_static
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+#define SECOND_COUNT 50000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_zone(char *label, TZ_Region *tz) {
+	int64_t sink = 0;
+	int64_t base = 1704067200;
+
+	double start = now_ns();
+	for (int64_t i = 0; i < SECOND_COUNT; i++) {
+		TZ_Time t = tz_time_to_tz(tz_time_from_unix_seconds(base + i), tz);
+		TZ_HMS hms = tz_get_hms(t);
+		sink += hms.hours + hms.minutes + hms.seconds;
+	}
+	double hms_ns = (now_ns() - start) / SECOND_COUNT;
+
+	start = now_ns();
+	for (int64_t i = 0; i < SECOND_COUNT; i++) {
+		TZ_Time t = tz_time_to_tz(tz_time_from_unix_seconds(base + (i * 3)), tz);
+		TZ_Date date = tz_get_date(t);
+		sink += date.year + date.month + date.day;
+	}
+	double date_ns = (now_ns() - start) / SECOND_COUNT;
+
+	printf("%-18s to_tz + get_hms %5.2f ns   to_tz + get_date %5.2f ns   (%lld)\n", label, hms_ns, date_ns, (long long)(sink & 0xF));
+}
+
+int main(void) {
+#if defined(LIBTZ_STATIC)
+	printf("LIBTZ_STATIC\n");
+#else
+	printf("linked libtz.o\n");
+#endif
+
+	bench_zone("UTC", NULL);
+
+	TZ_Region *tz;
+	if (tz_region_load("America/New_York", &tz)) {
+		bench_zone("America/New_York", tz);
+		tz_region_build_day_table(tz, 2024, 2030);
+		bench_zone("  with day table", tz);
+		tz_region_destroy(tz);
+	}
+	return 0;
+}
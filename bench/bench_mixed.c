@@ -0,0 +1,76 @@
+// Mixed-zone conversion: tz_convert_mixed against a per-row tz_time_to_tz loop
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_mixed.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+#define ROW_COUNT 10000000
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(void) {
+	TZ_Zone_Index *index;
+	if (!tz_zone_index_build(NULL, &index)) {
+		fprintf(stderr, "failed to build the zone index\n");
+		return 1;
+	}
+
+	int32_t zone_count = tz_zone_index_count(index);
+	TZ_Region **regions = (TZ_Region **)calloc(zone_count, sizeof(TZ_Region *));
+	int32_t loaded = 0;
+	for (int32_t i = 0; i < zone_count; i++) {
+		if (tz_region_load(tz_zone_index_name(index, i), &regions[loaded])) {
+			loaded += 1;
+		}
+	}
+	if (loaded == 0) {
+		fprintf(stderr, "no zones could be loaded\n");
+		return 1;
+	}
+
+	// An event table: timestamps rising over a year, each row in a random user's zone
+	int64_t *utc = (int64_t *)malloc(ROW_COUNT * sizeof(int64_t));
+	int64_t *local = (int64_t *)malloc(ROW_COUNT * sizeof(int64_t));
+	int64_t *expect = (int64_t *)malloc(ROW_COUNT * sizeof(int64_t));
+	TZ_Region **zones = (TZ_Region **)malloc(ROW_COUNT * sizeof(TZ_Region *));
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (int64_t i = 0; i < ROW_COUNT; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		utc[i] = 1704067200 + (i * 31536000) / ROW_COUNT;
+		zones[i] = regions[x % (uint64_t)loaded];
+	}
+
+	double start = now_ns();
+	for (int64_t i = 0; i < ROW_COUNT; i++) {
+		expect[i] = tz_time_to_tz(tz_time_from_unix_seconds(utc[i]), zones[i]).time;
+	}
+	double naive_ns = (now_ns() - start) / ROW_COUNT;
+
+	start = now_ns();
+	tz_convert_mixed(zones, utc, local, ROW_COUNT);
+	double mixed_ns = (now_ns() - start) / ROW_COUNT;
+
+	int64_t mismatches = 0;
+	for (int64_t i = 0; i < ROW_COUNT; i++) {
+		mismatches += (local[i] != expect[i]);
+	}
+
+	printf("%d zones, %d rows\n", loaded, ROW_COUNT);
+	printf("tz_time_to_tz per row: %6.1f ns/row\n", naive_ns);
+	printf("tz_convert_mixed:      %6.1f ns/row\n", mixed_ns);
+	printf("mismatches:            %lld\n", (long long)mismatches);
+
+	for (int32_t i = 0; i < loaded; i++) {
+		tz_region_destroy(regions[i]);
+	}
+	tz_zone_index_destroy(index);
+	return mismatches != 0;
+}
@@ -0,0 +1,74 @@
+// Loading every zone from tzdata.zi against opening each TZif file
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_tzdata.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(void) {
+	double start = now_ns();
+	TZ_Tzdata *db;
+	if (!tz_tzdata_load(NULL, &db)) {
+		fprintf(stderr, "failed to load tzdata.zi\n");
+		return 1;
+	}
+	double load_ns = now_ns() - start;
+
+	int64_t name_count = tz_tzdata_count(db);
+	TZ_Region **compiled = (TZ_Region **)calloc(name_count, sizeof(TZ_Region *));
+	TZ_Region **files = (TZ_Region **)calloc(name_count, sizeof(TZ_Region *));
+	bool *ok = (bool *)calloc(name_count, sizeof(bool));
+
+	start = now_ns();
+	for (int64_t i = 0; i < name_count; i++) {
+		ok[i] = tz_tzdata_region(db, tz_tzdata_name(db, i), &compiled[i]);
+	}
+	double compile_ns = now_ns() - start;
+
+	start = now_ns();
+	for (int64_t i = 0; i < name_count; i++) {
+		ok[i] &= tz_region_load(tz_tzdata_name(db, i), &files[i]);
+	}
+	double file_ns = now_ns() - start;
+
+	// Lookups between 1900 and 2037, where both sets of tables apply
+	int64_t checked = 0;
+	int64_t mismatches = 0;
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (int64_t i = 0; i < name_count; i++) {
+		if (!ok[i]) {
+			continue;
+		}
+		for (int j = 0; j < 10000; j++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			int64_t t = -2208988800ll + (int64_t)(x % 4354000000ull);
+			TZ_Lookup a, b;
+			tz_lookup(compiled[i], t, &a);
+			tz_lookup(files[i], t, &b);
+			mismatches += a.utc_offset != b.utc_offset || a.dst != b.dst || strcmp(a.shortname, b.shortname) != 0;
+			checked += 1;
+		}
+	}
+
+	printf("tzdata %s, %lld names\n", tz_tzdata_version(db), (long long)name_count);
+	printf("tzdata.zi: %7.2f ms to load, %7.2f ms to compile every zone\n", load_ns / 1e6, compile_ns / 1e6);
+	printf("TZif:      %7.2f ms to load every zone\n", file_ns / 1e6);
+	printf("mismatches: %lld of %lld\n", (long long)mismatches, (long long)checked);
+
+	for (int64_t i = 0; i < name_count; i++) {
+		tz_region_destroy(compiled[i]);
+		tz_region_destroy(files[i]);
+	}
+	tz_tzdata_destroy(db);
+	return mismatches != 0;
+}
@@ -0,0 +1,118 @@
+// A dashboard refresh over every zone: tz_time_to_tz on each one against tz_world_clock_advance
+// Build with bench/build.sh, or: clang -O2 -pthread bench/bench_world_clock.c libtz.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../libtz.h"
+
+// A year of refreshes, every ten minutes
+#define STEP_SECONDS 600
+#define STEP_COUNT   (365 * 24 * 6)
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(void) {
+	TZ_Zone_Index *index;
+	if (!tz_zone_index_build(NULL, &index)) {
+		fprintf(stderr, "failed to build the zone index\n");
+		return 1;
+	}
+
+	int32_t zone_count = tz_zone_index_count(index);
+	TZ_Region **zones = (TZ_Region **)calloc(zone_count, sizeof(TZ_Region *));
+	int32_t loaded = 0;
+	for (int32_t i = 0; i < zone_count; i++) {
+		if (tz_region_load(tz_zone_index_name(index, i), &zones[loaded])) {
+			loaded += 1;
+		}
+	}
+	if (loaded == 0) {
+		fprintf(stderr, "no zones could be loaded\n");
+		return 1;
+	}
+
+	int64_t start = 1735689600; // 2025-01-01
+	int64_t sink = 0;
+
+	double begin = now_ns();
+	for (int64_t step = 0; step < STEP_COUNT; step++) {
+		TZ_Time utc = tz_time_from_unix_seconds(start + (step * STEP_SECONDS));
+		for (int32_t i = 0; i < loaded; i++) {
+			TZ_Time local = tz_time_to_tz(utc, zones[i]);
+			sink += local.time;
+		}
+	}
+	double convert_ns = (now_ns() - begin) / STEP_COUNT;
+
+	TZ_World_Clock *clock;
+	if (!tz_world_clock_create(zones, loaded, start, &clock)) {
+		fprintf(stderr, "failed to create the world clock\n");
+		return 1;
+	}
+	int64_t changes = 0;
+	begin = now_ns();
+	for (int64_t step = 1; step < STEP_COUNT; step++) {
+		changes += tz_world_clock_advance(clock, start + (step * STEP_SECONDS));
+		sink += tz_world_clock_states(clock)[step % loaded].utc_offset;
+	}
+	double advance_ns = (now_ns() - begin) / STEP_COUNT;
+
+	// Replay with a fresh clock, checking every zone against tz_lookup and every change list against the previous step
+	tz_world_clock_destroy(clock);
+	tz_world_clock_create(zones, loaded, start, &clock);
+	TZ_Lookup *prev = (TZ_Lookup *)malloc(loaded * sizeof(TZ_Lookup));
+	memcpy(prev, tz_world_clock_states(clock), loaded * sizeof(TZ_Lookup));
+	bool *flagged = (bool *)calloc(loaded, sizeof(bool));
+	int64_t mismatches = 0;
+	for (int64_t step = 1; step < STEP_COUNT; step += 1 + (step % 3)) {
+		int64_t utc = start + (step * STEP_SECONDS);
+		int64_t changed = tz_world_clock_advance(clock, utc);
+		int64_t *changed_zones = tz_world_clock_changed(clock);
+		for (int64_t i = 0; i < changed; i++) {
+			flagged[changed_zones[i]] = true;
+		}
+
+		TZ_Lookup *states = tz_world_clock_states(clock);
+		for (int32_t i = 0; i < loaded; i++) {
+			TZ_Lookup want;
+			tz_lookup(zones[i], utc, &want);
+			bool moved = want.utc_offset != prev[i].utc_offset || want.dst != prev[i].dst || strcmp(want.shortname, prev[i].shortname) != 0;
+			mismatches += want.utc_offset != states[i].utc_offset || want.dst != states[i].dst ||
+				strcmp(want.shortname, states[i].shortname) != 0 || moved != flagged[i];
+			prev[i] = want;
+			flagged[i] = false;
+		}
+	}
+
+	// And once backwards
+	int64_t back = tz_world_clock_advance(clock, start);
+	TZ_Lookup *states = tz_world_clock_states(clock);
+	for (int32_t i = 0; i < loaded; i++) {
+		TZ_Lookup want;
+		tz_lookup(zones[i], start, &want);
+		mismatches += want.utc_offset != states[i].utc_offset || strcmp(want.shortname, states[i].shortname) != 0;
+	}
+
+	printf("%d zones, %d refreshes, %lld changes (%lld going back)\n", loaded, STEP_COUNT, (long long)changes, (long long)back);
+	printf("tz_time_to_tz:          %10.1f ns/refresh\n", convert_ns);
+	printf("tz_world_clock_advance: %10.1f ns/refresh\n", advance_ns);
+	printf("mismatches: %lld  (%lld)\n", (long long)mismatches, (long long)(sink & 0xF));
+
+	tz_world_clock_destroy(clock);
+	for (int32_t i = 0; i < loaded; i++) {
+		tz_region_destroy(zones[i]);
+	}
+	free(zones);
+	free(prev);
+	free(flagged);
+	tz_zone_index_destroy(index);
+	return mismatches != 0;
+}
@@ -0,0 +1,10 @@
+clang -O2 -c -o libtz.o ../libtz.c
+clang++ -std=c++20 -O2 -pthread -o bench_chrono bench_chrono.cpp libtz.o
+clang -O2 -pthread -o bench_mixed bench_mixed.c libtz.o
+clang -O2 -pthread -o bench_compress bench_compress.c libtz.o
+clang -O2 -pthread -o bench_inline bench_inline.c libtz.o
+clang -O2 -pthread -DLIBTZ_STATIC -o bench_inline_static bench_inline.c
+clang -O2 -pthread -o bench_tzdata bench_tzdata.c libtz.o
+clang -O2 -pthread -o bench_world_clock bench_world_clock.c libtz.o
+clang -O2 -pthread -o bench_abbrev bench_abbrev.c libtz.o
+clang -O2 -pthread -o bench_calendar bench_calendar.c libtz.o
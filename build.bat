@@ -1 +1 @@
-clang -g -Wall -o tzload.exe main.c libtz.c
+clang -O2 -g -Wall -o tzload.exe main.c libtz.c
@@ -1 +1 @@
-clang -g -Wall -o tzload main.c libtz.c
+clang -O2 -g -Wall -pthread -o tzload main.c libtz.c
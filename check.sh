@@ -0,0 +1,19 @@
+# Runs tzload (built by build.sh) over known inputs; prints the failing cases and exits 1 on any mismatch
+fail=0
+check() {
+	got=$(printf '%s\n' "$1" | ./tzload --to UTC $2)
+	if [ "$got" != "$3" ]; then
+		echo "FAIL: '$1' $2: got '$got', want '$3'"
+		fail=1
+	fi
+}
+
+check '1700000000,a'                    ''          '2023-11-14T22:13:20+00:00,a'
+check '1700000000123,a'                 '--unit ms' '2023-11-14T22:13:20+00:00,a'
+check '1700000000123456,a'              '--unit us' '2023-11-14T22:13:20+00:00,a'
+check '1700000000123456789,a'           '--unit ns' '2023-11-14T22:13:20+00:00,a'
+check '999999999123456789,a'            '--unit ns' '2001-09-09T01:46:39+00:00,a'
+check '99999999999999999999,a'          '--unit ns' '99999999999999999999,a'
+check '2023-11-14T17:13:20-05:00,a'     ''          '2023-11-14T22:13:20+00:00,a'
+check 'not a time,a'                    ''          'not a time,a'
+exit $fail
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <time.h>
 
 #if defined(_WIN64) || defined(_WIN32)
 #define PLATFORM_WINDOWS
@@ -15,8 +16,14 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <icu.h>
+#include <io.h>
 #pragma comment(lib, "icu")
 #pragma comment(lib, "Advapi32")
+#else
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #endif
 
 #include "libtz.h"
@@ -26,7 +33,12 @@
 #define NTOH_32(x) __builtin_bswap32(x)
 #define NTOH_16(x) __builtin_bswap16(x)
 
+#ifndef MAX
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
 
 // SECTION: Platform-specific Utilities
 #if defined(PLATFORM_WINDOWS)
@@ -34,7 +46,7 @@ static bool open_file(FILE **file, char *filename, char *mode) {
 	return !!fopen_s(file, filename, mode);
 }
 
-char *utf16_to_utf8(uint16_t *wstr) {
+static char *utf16_to_utf8(uint16_t *wstr) {
 	int str_sz = WideCharToMultiByte(CP_UTF8, 0, wstr, -1, NULL, 0, NULL, NULL);
 	if (str_sz == 0) {
 		return "";
@@ -44,7 +56,7 @@ char *utf16_to_utf8(uint16_t *wstr) {
 	WideCharToMultiByte(CP_UTF8, 0, wstr, -1, out_str, str_sz, NULL, NULL);
 	return out_str;
 }
-uint16_t *utf8_to_utf16(char *str) {
+static uint16_t *utf8_to_utf16(char *str) {
 	int wstr_sz = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
 	if (wstr_sz == 0) {
 		return L"";
@@ -55,6 +67,10 @@ uint16_t *utf8_to_utf16(char *str) {
 	return out_wstr;
 }
 
+static int64_t read_fd(int fd, uint8_t *buf, size_t sz) {
+	return _read(fd, buf, (unsigned int)sz);
+}
+
 #else
 typedef struct {
 	char **strs;
@@ -83,6 +99,166 @@ static bool open_file(FILE **file, char *filename, char *mode) {
 	*file = f;
 	return true;
 }
+
+static int64_t read_fd(int fd, uint8_t *buf, size_t sz) {
+	for (;;) {
+		ssize_t ret = read(fd, buf, sz);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		return ret;
+	}
+}
+#endif
+
+// SECTION: Platform-specific Threading
+#if defined(PLATFORM_WINDOWS)
+typedef INIT_ONCE Once_Flag;
+#define ONCE_FLAG_INITIALIZER INIT_ONCE_STATIC_INIT
+
+static BOOL CALLBACK once_trampoline(PINIT_ONCE once, PVOID param, PVOID *ctx) {
+	((void (*)(void))param)();
+	return TRUE;
+}
+
+static void run_once(Once_Flag *flag, void (*fn)(void)) {
+	InitOnceExecuteOnce(flag, once_trampoline, (PVOID)fn, NULL);
+}
+
+static int64_t clock_now_ns(void) {
+	FILETIME ft;
+	GetSystemTimePreciseAsFileTime(&ft);
+
+	// FILETIME counts 100ns ticks from 1601-01-01
+	int64_t ticks = (int64_t)(((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+	return (ticks - 116444736000000000ll) * 100;
+}
+
+typedef HANDLE Thread;
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Cond;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define COND_INITIALIZER CONDITION_VARIABLE_INIT
+
+typedef struct {
+	void (*fn)(void *);
+	void *arg;
+} Thread_Start;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+	Thread_Start start = *(Thread_Start *)param;
+	free(param);
+	start.fn(start.arg);
+	return 0;
+}
+
+static bool thread_start(Thread *thread, void (*fn)(void *), void *arg) {
+	Thread_Start *start = malloc(sizeof(Thread_Start));
+	if (start == NULL) {
+		return false;
+	}
+	*start = (Thread_Start){.fn = fn, .arg = arg};
+
+	*thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+static void thread_join(Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+static void thread_detach(Thread thread) {
+	CloseHandle(thread);
+}
+
+static int32_t cpu_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int32_t)info.dwNumberOfProcessors;
+}
+
+static void mutex_init(Mutex *m)    { InitializeSRWLock(m); }
+static void mutex_destroy(Mutex *m) { }
+static void mutex_lock(Mutex *m)    { AcquireSRWLockExclusive(m); }
+static void mutex_unlock(Mutex *m)  { ReleaseSRWLockExclusive(m); }
+
+static void cond_init(Cond *c)           { InitializeConditionVariable(c); }
+static void cond_destroy(Cond *c)        { }
+static void cond_wait(Cond *c, Mutex *m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void cond_broadcast(Cond *c)      { WakeAllConditionVariable(c); }
+#else
+typedef pthread_once_t Once_Flag;
+#define ONCE_FLAG_INITIALIZER PTHREAD_ONCE_INIT
+
+static void run_once(Once_Flag *flag, void (*fn)(void)) {
+	pthread_once(flag, fn);
+}
+
+static int64_t clock_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000ll) + ts.tv_nsec;
+}
+
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+typedef struct {
+	void (*fn)(void *);
+	void *arg;
+} Thread_Start;
+
+static void *thread_trampoline(void *param) {
+	Thread_Start start = *(Thread_Start *)param;
+	free(param);
+	start.fn(start.arg);
+	return NULL;
+}
+
+static bool thread_start(Thread *thread, void (*fn)(void *), void *arg) {
+	Thread_Start *start = malloc(sizeof(Thread_Start));
+	if (start == NULL) {
+		return false;
+	}
+	*start = (Thread_Start){.fn = fn, .arg = arg};
+
+	if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+static void thread_join(Thread thread) {
+	pthread_join(thread, NULL);
+}
+
+static void thread_detach(Thread thread) {
+	pthread_detach(thread);
+}
+
+static int32_t cpu_count(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int32_t)count : 1;
+}
+
+static void mutex_init(Mutex *m)    { pthread_mutex_init(m, NULL); }
+static void mutex_destroy(Mutex *m) { pthread_mutex_destroy(m); }
+static void mutex_lock(Mutex *m)    { pthread_mutex_lock(m); }
+static void mutex_unlock(Mutex *m)  { pthread_mutex_unlock(m); }
+
+static void cond_init(Cond *c)           { pthread_cond_init(c, NULL); }
+static void cond_destroy(Cond *c)        { pthread_cond_destroy(c); }
+static void cond_wait(Cond *c, Mutex *m) { pthread_cond_wait(c, m); }
+static void cond_broadcast(Cond *c)      { pthread_cond_broadcast(c); }
 #endif
 
 // SECTION: Utilities
@@ -187,8 +363,9 @@ static bool is_numeric(uint8_t ch) {
 
 static bool parse_i64(char *str, int64_t *val, int64_t *len) {
 	char *endptr = NULL;
+	errno = 0;
 	int64_t ret = strtoll(str, &endptr, 10);
-	if (ret == 0 && errno == EINVAL) {
+	if ((ret == 0 && errno == EINVAL) || endptr == str) {
 		return false;
 	}
 
@@ -213,6 +390,20 @@ static bool parse_i64(char *str, int64_t *val, int64_t *len) {
 #define UNIX_TO_INTERNAL ((int64_t)((1969 * 365) + (1969 / 4) - (1969 / 100) + (1969 / 400)) * SECONDS_PER_DAY)
 #define UNIX_TO_ABSOLUTE (UNIX_TO_INTERNAL + INTERNAL_TO_ABSOLUTE)
 
+#define NS_PER_SECOND 1000000000ll
+
+static int64_t floor_div(int64_t a, int64_t b) {
+	int64_t q = a / b;
+	if ((a % b) != 0 && ((a < 0) != (b < 0))) {
+		q -= 1;
+	}
+	return q;
+}
+
+static int64_t floor_mod(int64_t a, int64_t b) {
+	return a - (floor_div(a, b) * b);
+}
+
 static int32_t days_before[] = {
     0,
     31,
@@ -263,6 +454,28 @@ static int64_t year_to_time(int64_t year) {
 	return ((year_gap * 365) + leap_count) * SECONDS_PER_DAY;
 }
 
+// Howard Hinnant's civil calendar algorithms, days are counted from 1970-01-01
+static int64_t days_from_civil(int64_t year, int64_t month, int64_t day) {
+	year -= (month <= 2);
+	int64_t era = floor_div(year, 400);
+	int64_t yoe = year - (era * 400);
+	int64_t doy = (((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5) + day - 1;
+	int64_t doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+	return (era * 146097) + doe - 719468;
+}
+
+static void civil_from_days(int64_t days, int64_t *year, int64_t *month, int64_t *day) {
+	days += 719468;
+	int64_t era = floor_div(days, 146097);
+	int64_t doe = days - (era * 146097);
+	int64_t yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
+	int64_t doy = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));
+	int64_t mp = ((5 * doy) + 2) / 153;
+	*day = doy - (((153 * mp) + 2) / 5) + 1;
+	*month = mp + ((mp < 10) ? 3 : -9);
+	*year = (yoe + (era * 400)) + (*month <= 2);
+}
+
 static int64_t last_day_of_month(int64_t year, int64_t month) {
 	int8_t month_days[] = {-1, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 	int64_t day = month_days[month];
@@ -277,6 +490,7 @@ static int64_t last_day_of_month(int64_t year, int64_t month) {
 #define TZIF_MAGIC 0x545A6966
 #define BIG_BANG_ISH -0x800000000000000ll
 #define TWO_AM 2 * 60 * 60
+#define TAI_UTC_BASE 10
 
 typedef enum {
 	V1 = 0,
@@ -347,7 +561,7 @@ static bool is_valid_quoted_char(uint8_t ch) {
 	return is_alphabetic(ch) || is_numeric(ch) || ch == '+' || ch == '-';
 }
 
-static bool parse_posix_tz_shortname(char *str, char **out, int64_t *idx) {
+static bool parse_posix_tz_shortname(char *str, char *out, size_t out_sz, int64_t *idx) {
 	bool was_quoted = false;
 	bool quoted = false;
 	int i = 0;
@@ -381,15 +595,21 @@ static bool parse_posix_tz_shortname(char *str, char **out, int64_t *idx) {
 		return false;
 	}
 
-	int end_idx = i;
+	char *name = str;
+	int64_t name_len = i;
+	int64_t end_idx = i;
 	if (was_quoted) {
+		name += 1;
+		name_len -= 1;
 		end_idx += 1;
-		*out = clonestr_sz(str+1, end_idx);
-		*idx = end_idx;
-	} else {
-		*out = clonestr_sz(str, end_idx);
-		*idx = end_idx;
 	}
+	if ((size_t)(name_len + 1) > out_sz) {
+		return false;
+	}
+
+	memcpy(out, name, name_len);
+	out[name_len] = 0;
+	*idx = end_idx;
 
 	return true;
 }
@@ -554,7 +774,7 @@ bool tz_parse_posix_tz(char *posix_tz, int tz_str_len, TZ_RRule *rrule) {
 	char dst_name[33] = {};
 
 	int64_t end_idx = 0;
-	if (!parse_posix_tz_shortname(tz_str, (char **)&std_name, &end_idx)) { return false; }
+	if (!parse_posix_tz_shortname(tz_str, std_name, sizeof(std_name), &end_idx)) { return false; }
 
 	int64_t std_offset = 0;
 	tz_str += end_idx;
@@ -580,7 +800,7 @@ bool tz_parse_posix_tz(char *posix_tz, int tz_str_len, TZ_RRule *rrule) {
 
 	int64_t dst_offset = std_offset + (60 * 60);
 	if (*tz_str != ',') {
-		if (!parse_posix_tz_shortname(tz_str, (char **)&dst_name, &end_idx)) { return false; }
+		if (!parse_posix_tz_shortname(tz_str, dst_name, sizeof(dst_name), &end_idx)) { return false; }
 		tz_str += end_idx;
 
 		if (*tz_str != ',') {
@@ -616,208 +836,566 @@ bool tz_parse_posix_tz(char *posix_tz, int tz_str_len, TZ_RRule *rrule) {
 	return true;
 }
 
-bool parse_tzif(uint8_t *buffer, size_t size, char *region_name, TZ_Region **out_region) {
-	Slice s = {.data = buffer, .len = size};
+// Regions get tagged with the cheapest lookup that can answer for them
+static TZ_Region_Kind region_kind(int64_t record_count, TZ_RRule *rrule) {
+	if (record_count > 0) {
+		return TZ_Region_Table;
+	}
+
+	return rrule->has_dst ? TZ_Region_Rule : TZ_Region_Fixed;
+}
 
-	TZif_Header *v1_hdr = (TZif_Header *)s.data;
-	tzif_hdr_to_native(v1_hdr);
+// The parser only ever holds the section it's currently reading, records get built
+// as soon as their sections arrive, so the footer is the only thing left to wait for
+typedef enum {
+	Parse_V1_Header,
+	Parse_V1_Data,
+	Parse_Header,
+	Parse_Transition_Times,
+	Parse_Transition_Types,
+	Parse_Local_Time_Types,
+	Parse_Strings,
+	Parse_Leapseconds,
+	Parse_Std_Wall_Tags,
+	Parse_UT_Tags,
+	Parse_Footer,
+	Parse_Done,
+	Parse_Failed,
+} Parse_Stage;
+
+#define MAX_FOOTER_LEN 256
+
+struct TZ_Parser {
+	Parse_Stage stage;
+	char *name;
+	TZif_Version version;
+	TZif_Header hdr;
+
+	uint8_t *section;
+	uint64_t section_cap;
+	uint64_t section_len;
+	uint64_t section_filled;
+	uint64_t skip_left;
+
+	uint8_t *transition_types;
+	Local_Time_Type *local_time_types;
+
+	TZ_Record *records;
+	char **ltt_names;
+	TZ_Leapsecond *leapseconds;
+
+	char footer[MAX_FOOTER_LEN + 1];
+	int64_t footer_len;
+};
 
-	if (v1_hdr->magic != TZIF_MAGIC) {
+static bool parser_check_header(TZif_Header *hdr) {
+	if (hdr->magic != TZIF_MAGIC) {
 		return false;
 	}
-	if (v1_hdr->typecnt == 0 || v1_hdr->charcnt == 0) {
+	if (hdr->typecnt == 0 || hdr->charcnt == 0) {
 		return false;
 	}
-	if (v1_hdr->isutcnt != 0 && v1_hdr->isutcnt != v1_hdr->typecnt) {
+	if (hdr->isutcnt != 0 && hdr->isutcnt != hdr->typecnt) {
 		return false;
 	}
 
-	if (v1_hdr->version == V1) {
-		return false;
-	}
+	return true;
+}
 
-	if (v1_hdr->version != V2 && v1_hdr->version != V3) {
-		return false;
+static bool parser_begin_section(TZ_Parser *p, Parse_Stage stage, uint64_t len) {
+	if (len > p->section_cap) {
+		uint8_t *section = (uint8_t *)realloc(p->section, len);
+		if (section == NULL) {
+			return false;
+		}
+		p->section = section;
+		p->section_cap = len;
 	}
 
-	int first_block_size = tzif_data_block_size(v1_hdr, V1);
-	if (s.len <= sizeof(TZif_Header) + first_block_size) {
-		return false;
-	}
-	s = slice_sub(s, sizeof(TZif_Header) + first_block_size);
+	p->stage = stage;
+	p->section_len = len;
+	p->section_filled = 0;
+	return true;
+}
 
-	TZif_Header *real_hdr = (TZif_Header *)s.data;
-	tzif_hdr_to_native(real_hdr);
+static bool parser_process_section(TZ_Parser *p) {
+	TZif_Header *hdr = &p->hdr;
 
-	if (real_hdr->magic != TZIF_MAGIC) {
-		return false;
-	}
-	if (real_hdr->typecnt == 0 || real_hdr->charcnt == 0) {
-		return false;
-	}
-	if (real_hdr->isutcnt != 0 && real_hdr->isutcnt != real_hdr->typecnt) {
-		return false;
-	}
-	if (real_hdr->isstdcnt != 0 && real_hdr->isstdcnt != real_hdr->typecnt) {
-		return false;
-	}
+	switch (p->stage) {
+		case Parse_V1_Header: {
+			memcpy(hdr, p->section, sizeof(TZif_Header));
+			tzif_hdr_to_native(hdr);
+			if (!parser_check_header(hdr)) {
+				return false;
+			}
 
-	int real_block_size = tzif_data_block_size(real_hdr, (TZif_Version)v1_hdr->version);
-	if (s.len <= sizeof(TZif_Header) + real_block_size) {
-		return false;
-	}
-	s = slice_sub(s, sizeof(TZif_Header));
+			if (hdr->version == V1) {
+				return false;
+			}
+			if (hdr->version != V2 && hdr->version != V3 && hdr->version != V4) {
+				return false;
+			}
+			p->version = (TZif_Version)hdr->version;
 
-	// Scan and flip all the tzif arrays
-	int64_t *transition_times = (int64_t *)s.data;
-	for (int i = 0; i < real_hdr->timecnt; i++) {
-		int64_t *time = &transition_times[i];
-		*time = NTOH_64(*time);
-		if (*time < BIG_BANG_ISH) {
-			return false;
-		}
-	}
-	s = slice_sub(s, real_hdr->timecnt * sizeof(int64_t));
+			p->stage = Parse_V1_Data;
+			p->skip_left = tzif_data_block_size(hdr, V1);
+			if (p->skip_left == 0) {
+				return parser_begin_section(p, Parse_Header, sizeof(TZif_Header));
+			}
+			return true;
+		} break;
+		case Parse_Header: {
+			memcpy(hdr, p->section, sizeof(TZif_Header));
+			tzif_hdr_to_native(hdr);
+			if (!parser_check_header(hdr)) {
+				return false;
+			}
+			if (hdr->isstdcnt != 0 && hdr->isstdcnt != hdr->typecnt) {
+				return false;
+			}
 
-	uint8_t *transition_types = s.data;
-	for (int i = 0; i < real_hdr->timecnt; i++) {
-		uint8_t type = transition_types[i];
-		if ((int)type > ((int)real_hdr->typecnt - 1)) {
-			return false;
-		}
-	}
-	s = slice_sub(s, real_hdr->timecnt);
+			p->records = (TZ_Record *)calloc(MAX(1, hdr->timecnt), sizeof(TZ_Record));
+			p->transition_types = (uint8_t *)malloc(MAX(1, hdr->timecnt));
+			p->local_time_types = (Local_Time_Type *)malloc(hdr->typecnt * sizeof(Local_Time_Type));
+			if (p->records == NULL || p->transition_types == NULL || p->local_time_types == NULL) {
+				return false;
+			}
 
-	Local_Time_Type *local_time_types = (Local_Time_Type *)s.data;
-	for (int i = 0; i < real_hdr->typecnt; i++) {
-		Local_Time_Type *ltt = &local_time_types[i];
-		ltt->utoff = NTOH_32(ltt->utoff);
+			return parser_begin_section(p, Parse_Transition_Times, (uint64_t)hdr->timecnt * sizeof(int64_t));
+		} break;
+		case Parse_Transition_Times: {
+			for (int i = 0; i < hdr->timecnt; i++) {
+				int64_t time;
+				memcpy(&time, p->section + (i * sizeof(int64_t)), sizeof(int64_t));
+				time = NTOH_64(time);
+				if (time < BIG_BANG_ISH) {
+					return false;
+				}
+				p->records[i].time = time;
+			}
 
-		// UT offset should be > -25 and < 26 hours
-		if ((int)ltt->utoff < -89999 || (int)ltt->utoff > 93599) {
-			return false;
-		}
+			return parser_begin_section(p, Parse_Transition_Types, hdr->timecnt);
+		} break;
+		case Parse_Transition_Types: {
+			for (int i = 0; i < hdr->timecnt; i++) {
+				uint8_t type = p->section[i];
+				if ((int)type > ((int)hdr->typecnt - 1)) {
+					return false;
+				}
+				p->transition_types[i] = type;
+			}
 
-		if (ltt->dst != DST && ltt->dst != Standard) {
-			return false;
-		}
+			return parser_begin_section(p, Parse_Local_Time_Types, (uint64_t)hdr->typecnt * sizeof(Local_Time_Type));
+		} break;
+		case Parse_Local_Time_Types: {
+			for (int i = 0; i < hdr->typecnt; i++) {
+				Local_Time_Type *ltt = &p->local_time_types[i];
+				memcpy(ltt, p->section + (i * sizeof(Local_Time_Type)), sizeof(Local_Time_Type));
+				ltt->utoff = NTOH_32(ltt->utoff);
+
+				// UT offset should be > -25 and < 26 hours
+				if ((int)ltt->utoff < -89999 || (int)ltt->utoff > 93599) {
+					return false;
+				}
+
+				if (ltt->dst != DST && ltt->dst != Standard) {
+					return false;
+				}
+
+				if ((int)ltt->idx > ((int)hdr->charcnt - 1)) {
+					return false;
+				}
+			}
+
+			return parser_begin_section(p, Parse_Strings, hdr->charcnt);
+		} break;
+		case Parse_Strings: {
+			Slice str_table = {.data = p->section, .len = hdr->charcnt};
+			p->ltt_names = (char **)calloc(hdr->typecnt, sizeof(char *));
+			if (p->ltt_names == NULL) {
+				return false;
+			}
+			for (int i = 0; i < hdr->typecnt; i++) {
+				Local_Time_Type ltt = p->local_time_types[i];
+
+				Slice ltt_name_str = slice_sub(str_table, ltt.idx);
+				p->ltt_names[i] = clonestr_sz((char *)ltt_name_str.data, ltt_name_str.len);
+			}
+
+			for (int i = 0; i < hdr->timecnt; i++) {
+				int trans_idx = p->transition_types[i];
+				Local_Time_Type ltt = p->local_time_types[trans_idx];
+
+				p->records[i].utc_offset = ltt.utoff;
+				p->records[i].shortname  = p->ltt_names[trans_idx];
+				p->records[i].dst        = !!ltt.dst;
+			}
+
+			return parser_begin_section(p, Parse_Leapseconds, (uint64_t)hdr->leapcnt * sizeof(Leapsecond_Record));
+		} break;
+		case Parse_Leapseconds: {
+			if (hdr->leapcnt == 0) {
+				return parser_begin_section(p, Parse_Std_Wall_Tags, hdr->isstdcnt);
+			}
+
+			Leapsecond_Record *leapsecond_records = (Leapsecond_Record *)p->section;
+			for (int i = 0; i < hdr->leapcnt; i++) {
+				Leapsecond_Record *record = &leapsecond_records[i];
+				record->occur = NTOH_64(record->occur);
+				record->corr = NTOH_32(record->corr);
+			}
+			if (p->version < V4 && leapsecond_records[0].occur < 0) {
+				return false;
+			}
+
+			// Leapsecond occurrences are counted on the leap-inclusive timescale,
+			// they get converted into the first POSIX second using the new TAI - UTC offset
+			p->leapseconds = (TZ_Leapsecond *)malloc(hdr->leapcnt * sizeof(TZ_Leapsecond));
+			if (p->leapseconds == NULL) {
+				return false;
+			}
+			int64_t prev_corr = 0;
+			for (int i = 0; i < hdr->leapcnt; i++) {
+				Leapsecond_Record record = leapsecond_records[i];
+				p->leapseconds[i] = (TZ_Leapsecond){
+					.time       = record.occur - prev_corr,
+					.tai_offset = TAI_UTC_BASE + record.corr,
+				};
+				prev_corr = record.corr;
+			}
+
+			// Transitions in right/ zones are also leap-inclusive
+			for (int i = 0; i < hdr->timecnt; i++) {
+				int64_t trans_time = p->records[i].time;
+				for (int j = hdr->leapcnt - 1; j >= 0; j--) {
+					if (leapsecond_records[j].occur <= trans_time) {
+						p->records[i].time = trans_time - leapsecond_records[j].corr;
+						break;
+					}
+				}
+			}
+
+			return parser_begin_section(p, Parse_Std_Wall_Tags, hdr->isstdcnt);
+		} break;
+		case Parse_Std_Wall_Tags: {
+			for (int i = 0; i < hdr->isstdcnt; i++) {
+				uint8_t stdwall_tag = p->section[i];
+				if (stdwall_tag != 0 && stdwall_tag != 1) {
+					return false;
+				}
+			}
+
+			return parser_begin_section(p, Parse_UT_Tags, hdr->isutcnt);
+		} break;
+		case Parse_UT_Tags: {
+			for (int i = 0; i < hdr->isutcnt; i++) {
+				uint8_t ut_tag = p->section[i];
+				if (ut_tag != 0 && ut_tag != 1) {
+					return false;
+				}
+			}
+
+			p->stage = Parse_Footer;
+			p->footer_len = -1;
+			return true;
+		} break;
+		default: { return false; }
+	}
+
+	return false;
+}
 
-		if ((int)ltt->idx > ((int)real_hdr->charcnt - 1)) {
+// Footers are "\n<posix tz string>\n", the string itself may be empty
+static bool parser_feed_footer(TZ_Parser *p, uint8_t ch) {
+	if (p->footer_len < 0) {
+		if (ch != '\n') {
 			return false;
 		}
+		p->footer_len = 0;
+		return true;
 	}
-	s = slice_sub(s, real_hdr->typecnt * sizeof(Local_Time_Type));
 
-	char *timezone_string_table = (char *)s.data;
-	s = slice_sub(s, real_hdr->charcnt);
-
-	Leapsecond_Record *leapsecond_records = (Leapsecond_Record *)s.data;
-	for (int i = 0; i < real_hdr->leapcnt; i++) {
-		Leapsecond_Record *record = &leapsecond_records[i];
-		record->occur = NTOH_64(record->occur);
-		record->corr = NTOH_32(record->corr);
+	if (ch == '\n') {
+		p->footer[p->footer_len] = 0;
+		p->stage = Parse_Done;
+		return true;
 	}
-	if (real_hdr->leapcnt > 0 && leapsecond_records[0].occur < 0) {
+
+	if (ch == 0 || (p->footer_len == 0 && ch == ':') || p->footer_len == MAX_FOOTER_LEN) {
 		return false;
 	}
-	s = slice_sub(s, real_hdr->leapcnt * sizeof(Leapsecond_Record));
 
-	uint8_t *standard_wall_tags = s.data;
-	for (int i = 0; i < real_hdr->isstdcnt; i++) {
-		uint8_t stdwall_tag = standard_wall_tags[i];
-		if (stdwall_tag != 0 && stdwall_tag != 1) {
-			return false;
-		}
-	}
-	s = slice_sub(s, real_hdr->isstdcnt);
+	p->footer[p->footer_len] = (char)ch;
+	p->footer_len += 1;
+	return true;
+}
 
-	uint8_t *ut_tags = s.data;
-	for (int i = 0; i < real_hdr->isutcnt; i++) {
-		uint8_t ut_tag = ut_tags[i];
-		if (ut_tag != 0 && ut_tag != 1) {
-			return false;
+static void parser_free(TZ_Parser *p, bool free_results) {
+	if (free_results) {
+		if (p->ltt_names != NULL) {
+			for (int i = 0; i < p->hdr.typecnt; i++) {
+				free(p->ltt_names[i]);
+			}
 		}
+		free(p->ltt_names);
+		free(p->records);
+		free(p->leapseconds);
 	}
-	s = slice_sub(s, real_hdr->isutcnt);
 
-	// Start of footer
-	if (s.data[0] != '\n') {
+	free(p->section);
+	free(p->transition_types);
+	free(p->local_time_types);
+	free(p->name);
+	free(p);
+}
+
+bool tz_parser_create(char *reg_str, TZ_Parser **parser) {
+	TZ_Parser *p = (TZ_Parser *)calloc(1, sizeof(TZ_Parser));
+	if (p == NULL) {
 		return false;
 	}
-	s = slice_sub(s, 1);
 
-	if (s.data[0] == ':') {
+	p->name = clonestr(reg_str);
+	if (!parser_begin_section(p, Parse_V1_Header, sizeof(TZif_Header))) {
+		parser_free(p, true);
 		return false;
 	}
 
-	for (int i = 0; i < s.len; i++) {
-		char ch = (char)s.data[i];
-		if (ch == '\n') {
-			break;
-		}
+	*parser = p;
+	return true;
+}
 
-		if (ch == 0) {
-			return false;
+bool tz_parser_feed(TZ_Parser *p, uint8_t *chunk, size_t len) {
+	while (len > 0) {
+		switch (p->stage) {
+			case Parse_V1_Data: {
+				uint64_t skip = (len < p->skip_left) ? len : p->skip_left;
+				chunk += skip;
+				len -= skip;
+				p->skip_left -= skip;
+
+				if (p->skip_left == 0 && !parser_begin_section(p, Parse_Header, sizeof(TZif_Header))) {
+					p->stage = Parse_Failed;
+				}
+			} break;
+			case Parse_Footer: {
+				if (!parser_feed_footer(p, *chunk)) {
+					p->stage = Parse_Failed;
+					break;
+				}
+				chunk += 1;
+				len -= 1;
+			} break;
+			case Parse_Done: {
+				// Anything past the footer isn't ours to look at
+				return true;
+			} break;
+			case Parse_Failed: {
+				return false;
+			} break;
+			default: {
+				uint64_t want = p->section_len - p->section_filled;
+				uint64_t take = (len < want) ? len : want;
+				memcpy(p->section + p->section_filled, chunk, take);
+				p->section_filled += take;
+				chunk += take;
+				len -= take;
+
+				// Empty sections get processed right away, there's nothing to wait for
+				while (p->stage != Parse_V1_Data && p->stage < Parse_Footer && p->section_filled == p->section_len) {
+					if (!parser_process_section(p)) {
+						p->stage = Parse_Failed;
+						break;
+					}
+				}
+			} break;
 		}
 	}
-	char *footer_str = (char *)s.data;
 
-	TZ_RRule rrule;
-	if (!tz_parse_posix_tz(footer_str, s.len - 1, &rrule)) { return false; }
+	return p->stage != Parse_Failed;
+}
 
-	// UTC is a special case, we don't need to alloc
-	if (real_hdr->typecnt == 1 && local_time_types[0].utoff == 0) {
-		*out_region = NULL;
-		return true;
+bool tz_parser_finish(TZ_Parser *p, TZ_Region **out_region) {
+	if (p->stage != Parse_Done) {
+		parser_free(p, true);
+		return false;
 	}
 
-	Slice str_table = {.data = (uint8_t *)timezone_string_table, .len = real_hdr->charcnt};
-	char **ltt_names = (char **)malloc(sizeof(char *) * real_hdr->typecnt);
-	for (int i = 0; i < real_hdr->typecnt; i++) {
-		Local_Time_Type ltt = local_time_types[i];
+	TZif_Header *hdr = &p->hdr;
 
-		Slice ltt_name_str = slice_sub(str_table, ltt.idx);
-		ltt_names[i] = clonestr_sz((char *)ltt_name_str.data, ltt_name_str.len);
+	// right/ zones ship with an empty footer, the last type just carries on
+	TZ_RRule rrule = {};
+	if (p->footer_len > 0) {
+		if (!tz_parse_posix_tz(p->footer, (int)p->footer_len, &rrule)) {
+			parser_free(p, true);
+			return false;
+		}
+	} else {
+		Local_Time_Type last = p->local_time_types[(hdr->timecnt > 0) ? p->transition_types[hdr->timecnt - 1] : 0];
+		rrule = (TZ_RRule){
+			.has_dst    = false,
+			.std_offset = last.utoff,
+		};
+		copystr_sz(rrule.std_name, sizeof(rrule.std_name), p->ltt_names[(hdr->timecnt > 0) ? p->transition_types[hdr->timecnt - 1] : 0]);
 	}
 
-	TZ_Record *records = (TZ_Record *)malloc(real_hdr->timecnt * sizeof(TZ_Record));
-	for (int i = 0; i < real_hdr->timecnt; i++) {
-		int64_t trans_time = transition_times[i];
-		int trans_idx = transition_types[i];
-		Local_Time_Type ltt = local_time_types[trans_idx];
-
-		records[i] = (TZ_Record){
-			.time       = trans_time,
-			.utc_offset = ltt.utoff,
-			.shortname  = ltt_names[trans_idx],
-			.dst        = !!ltt.dst,
-		};
+	// UTC is a special case, we don't need to alloc, unless we need to keep the leapsecond table around
+	if (hdr->typecnt == 1 && p->local_time_types[0].utoff == 0 && hdr->leapcnt == 0) {
+		parser_free(p, true);
+		*out_region = NULL;
+		return true;
 	}
 
 	TZ_Region *region = (TZ_Region *)malloc(sizeof(TZ_Region));
 	*region = (TZ_Region){
-		.records         = records,
-		.record_count    = real_hdr->timecnt,
-		.shortnames      = ltt_names,
-		.shortname_count = real_hdr->typecnt,
-		.name            = clonestr(region_name),
+		.kind             = region_kind(hdr->timecnt, &rrule),
+		.records          = p->records,
+		.record_count     = hdr->timecnt,
+		.shortnames       = p->ltt_names,
+		.shortname_count  = hdr->typecnt,
+		.leapseconds      = p->leapseconds,
+		.leapsecond_count = hdr->leapcnt,
+		.name             = clonestr(p->name),
+		.rrule            = rrule,
 	};
+	parser_free(p, false);
+
 	*out_region = region;
 	return true;
 }
 
+void tz_parser_destroy(TZ_Parser *p) {
+	if (p == NULL) return;
+	parser_free(p, true);
+}
+
+static bool parse_tzif(uint8_t *buffer, size_t size, char *region_name, TZ_Region **out_region) {
+	TZ_Parser *p = NULL;
+	if (!tz_parser_create(region_name, &p)) return false;
+
+	if (!tz_parser_feed(p, buffer, size)) {
+		tz_parser_destroy(p);
+		return false;
+	}
+
+	return tz_parser_finish(p, out_region);
+}
+
+#define READ_CHUNK_SIZE 4096
+
 static bool load_tzif_file(char *path, char *name, TZ_Region **region) {
-	uint8_t *buffer = NULL;
-	size_t file_length = 0;
-	if (!load_entire_file(path, &buffer, &file_length)) return false;
+	FILE *f;
+	if (!open_file(&f, path, "rb")) { return false; }
 
-	bool ret = parse_tzif(buffer, file_length, name, region);
-	free(buffer);
+	TZ_Parser *p = NULL;
+	if (!tz_parser_create(name, &p)) {
+		fclose(f);
+		return false;
+	}
 
-	return ret;
+	uint8_t chunk[READ_CHUNK_SIZE];
+	size_t len = 0;
+	while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		if (!tz_parser_feed(p, chunk, len)) {
+			break;
+		}
+	}
+	fclose(f);
+
+	return tz_parser_finish(p, region);
+}
+
+static bool load_tzif_fd(int fd, char *name, TZ_Region **region) {
+	TZ_Parser *p = NULL;
+	if (!tz_parser_create(name, &p)) return false;
+
+	uint8_t chunk[READ_CHUNK_SIZE];
+	for (;;) {
+		int64_t len = read_fd(fd, chunk, sizeof(chunk));
+		if (len < 0) {
+			tz_parser_destroy(p);
+			return false;
+		}
+		if (len == 0) {
+			break;
+		}
+		if (!tz_parser_feed(p, chunk, (size_t)len)) {
+			break;
+		}
+	}
+
+	return tz_parser_finish(p, region);
 }
 
 // SECTION: Platform-specific TZ_Region Functions
+typedef struct {
+	char *name;
+	char *target; // NULL for a canonical zone, otherwise the name it links to
+	int64_t seq;
+	int32_t zone_id;
+} Zone_Name;
+
+typedef struct {
+	Zone_Name *names;
+	int64_t len;
+	int64_t cap;
+} Zone_Name_List;
+
+static void zone_names_add(Zone_Name_List *list, char *name, char *target) {
+	if (list->len + 1 > list->cap) {
+		list->cap = MAX(64, list->cap * 2);
+		list->names = (Zone_Name *)realloc(list->names, sizeof(Zone_Name) * list->cap);
+	}
+	list->names[list->len] = (Zone_Name){
+		.name    = clonestr(name),
+		.target  = (target != NULL) ? clonestr(target) : NULL,
+		.seq     = list->len,
+		.zone_id = -1,
+	};
+	list->len += 1;
+}
+
+// Picks the zone (Z) and link (L) lines out of a compiled tzdata.zi
+static void parse_tzdata_zi_names(char *data, size_t len, Zone_Name_List *list) {
+	char *end = data + len;
+	char *line = data;
+	while (line < end) {
+		char *nl = memchr(line, '\n', end - line);
+		char *line_end = (nl == NULL) ? end : nl;
+
+		if (line_end - line > 2 && (line[0] == 'Z' || line[0] == 'L') && line[1] == ' ') {
+			char *fields[3] = {0};
+			size_t lens[3] = {0};
+			int count = 0;
+			char *cur = line + 2;
+			while (cur < line_end && count < 3) {
+				while (cur < line_end && *cur == ' ') cur++;
+				char *start = cur;
+				while (cur < line_end && *cur != ' ' && *cur != '\r') cur++;
+				if (cur > start) {
+					fields[count] = start;
+					lens[count] = cur - start;
+					count += 1;
+				}
+			}
+
+			if (line[0] == 'Z' && count >= 1) {
+				char *name = clonestr_sz(fields[0], lens[0]);
+				zone_names_add(list, name, NULL);
+				free(name);
+			} else if (line[0] == 'L' && count >= 2) {
+				char *target = clonestr_sz(fields[0], lens[0]);
+				char *name = clonestr_sz(fields[1], lens[1]);
+				zone_names_add(list, name, target);
+				free(target);
+				free(name);
+			}
+		}
+
+		line = line_end + 1;
+	}
+}
+
 #if !defined(PLATFORM_WINDOWS)
 static char *local_tz_name(bool check_env) {
 	if (check_env) {
@@ -904,19 +1482,98 @@ static bool load_local_region(bool check_env, TZ_Region **region) {
 
 	return ret;
 }
-#else
-typedef struct {
-	char *std;
-	char *dst;
-} TZ_Abbrev;
 
-typedef struct {
-	char *key;
-	TZ_Abbrev value;
-} TZ_AbbrevMap;
+static bool is_tzif_file(char *path) {
+	FILE *f;
+	if (!open_file(&f, path, "rb")) return false;
 
-static TZ_AbbrevMap tz_abbrevs[] = {
-	{"Egypt Standard Time",             {"EET", "EEST"}},    // Africa/Cairo
+	char magic[4] = {0};
+	size_t got = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+
+	return got == sizeof(magic) && memcmp(magic, "TZif", sizeof(magic)) == 0;
+}
+
+static void walk_zoneinfo(char *root, char *real_root, char *rel, Zone_Name_List *list) {
+	char *path = (rel[0] != 0) ? str_join(2, "/", root, rel) : clonestr(root);
+	DIR *dir = opendir(path);
+	free(path);
+	if (dir == NULL) {
+		return;
+	}
+
+	size_t real_root_len = strlen(real_root);
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		char *file = ent->d_name;
+		if (file[0] == '.') {
+			continue;
+		}
+
+		// posix/ and right/ mirror the whole tree, and localtime isn't a zone name
+		if (rel[0] == 0 && (!strcmp(file, "posix") || !strcmp(file, "right") || !strcmp(file, "localtime") || !strcmp(file, "posixrules"))) {
+			continue;
+		}
+
+		char *child_rel = (rel[0] != 0) ? str_join(2, "/", rel, file) : clonestr(file);
+		char *child = str_join(2, "/", root, child_rel);
+
+		struct stat st;
+		if (lstat(child, &st) == 0) {
+			if (S_ISDIR(st.st_mode)) {
+				walk_zoneinfo(root, real_root, child_rel, list);
+			} else if (S_ISLNK(st.st_mode)) {
+				char *real = realpath(child, NULL);
+				if (real != NULL && strncmp(real, real_root, real_root_len) == 0 && real[real_root_len] == '/' && is_tzif_file(real)) {
+					zone_names_add(list, child_rel, real + real_root_len + 1);
+				}
+				free(real);
+			} else if (S_ISREG(st.st_mode) && is_tzif_file(child)) {
+				zone_names_add(list, child_rel, NULL);
+			}
+		}
+
+		free(child);
+		free(child_rel);
+	}
+	closedir(dir);
+}
+
+static bool collect_zone_names(char *zoneinfo_dir, Zone_Name_List *list) {
+	char *root = (zoneinfo_dir != NULL) ? zoneinfo_dir : (char *)"/usr/share/zoneinfo";
+	char *real_root = realpath(root, NULL);
+	if (real_root == NULL) {
+		return false;
+	}
+
+	// tzdata.zi knows which names are links, even where the tree uses copies or hard links
+	char *zi_path = str_join(2, "/", root, "tzdata.zi");
+	uint8_t *zi = NULL;
+	size_t zi_len = 0;
+	if (load_entire_file(zi_path, &zi, &zi_len)) {
+		parse_tzdata_zi_names((char *)zi, zi_len, list);
+		free(zi);
+	}
+	free(zi_path);
+
+	walk_zoneinfo(root, real_root, "", list);
+	free(real_root);
+
+	return list->len > 0;
+}
+#else
+typedef struct {
+	char *std;
+	char *dst;
+} TZ_Abbrev;
+
+typedef struct {
+	char *key;
+	TZ_Abbrev value;
+} TZ_AbbrevMap;
+
+static TZ_AbbrevMap tz_abbrevs[] = {
+	{"Egypt Standard Time",             {"EET", "EEST"}},    // Africa/Cairo
 	{"Morocco Standard Time",           {"+00", "+01"}},     // Africa/Casablanca
 	{"South Africa Standard Time",      {"SAST", "SAST"}},   // Africa/Johannesburg
 	{"South Sudan Standard Time",       {"CAT", "CAT"}},     // Africa/Juba
@@ -1057,7 +1714,7 @@ static TZ_AbbrevMap tz_abbrevs[] = {
 	{"Tonga Standard Time",             {"+13", "+13"}},     // Pacific/Tongatapu
 };
 
-char *iana_to_windows_tz(char *iana_name) {
+static char *iana_to_windows_tz(char *iana_name) {
 	UChar wintz_name_buffer[128] = {};
 	UErrorCode status = {};
 
@@ -1072,7 +1729,7 @@ char *iana_to_windows_tz(char *iana_name) {
 	return utf16_to_utf8(wintz_name_buffer);
 }
 
-char *local_tz_name(void) {
+static char *local_tz_name(void) {
 	UChar iana_name_buffer[128] = {};
 	UErrorCode status = {};
 
@@ -1182,6 +1839,7 @@ static bool load_region(char *region_name, TZ_Region **region) {
 
 	TZ_Region *out_region = (TZ_Region *)malloc(sizeof(TZ_Region));
 	*out_region = (TZ_Region){
+		.kind  = region_kind(0, &rrule),
 		.name  = clonestr(region_name),
 		.rrule = rrule,
 	};
@@ -1205,9 +1863,109 @@ static bool load_local_region(bool check_env, TZ_Region **region) {
 	return ret;
 }
 
+// Windows doesn't ship a zoneinfo tree, so names come from ICU unless a
+// directory with a tzdata.zi was given
+static bool collect_zone_names(char *zoneinfo_dir, Zone_Name_List *list) {
+	if (zoneinfo_dir != NULL) {
+		char *zi_path = str_join(2, "/", zoneinfo_dir, "tzdata.zi");
+		uint8_t *zi = NULL;
+		size_t zi_len = 0;
+		if (load_entire_file(zi_path, &zi, &zi_len)) {
+			parse_tzdata_zi_names((char *)zi, zi_len, list);
+			free(zi);
+		}
+		free(zi_path);
+		return list->len > 0;
+	}
+
+	UErrorCode status = {};
+	UEnumeration *zones = ucal_openTimeZones(&status);
+	if (status != U_ZERO_ERROR) {
+		return false;
+	}
+
+	const char *name;
+	int32_t name_len = 0;
+	while ((name = uenum_next(zones, &name_len, &status)) != NULL && status == U_ZERO_ERROR) {
+		UChar canonical_buffer[128] = {};
+		UBool is_system = 0;
+
+		uint16_t *name_wstr = utf8_to_utf16((char *)name);
+		ucal_getCanonicalTimeZoneID(name_wstr, -1, canonical_buffer, ARR_LEN(canonical_buffer), &is_system, &status);
+		free(name_wstr);
+		if (status != U_ZERO_ERROR || !is_system) {
+			status = U_ZERO_ERROR;
+			continue;
+		}
+
+		char *canonical = utf16_to_utf8(canonical_buffer);
+		zone_names_add(list, (char *)name, strcmp(canonical, name) ? canonical : NULL);
+		free(canonical);
+	}
+	uenum_close(zones);
+
+	return list->len > 0;
+}
+
 #endif
 
 // SECTION: Generic TZ_Region Functions
+// The optional compressed form of a table region's transitions. Every
+// TRANSITION_BLOCK_LEN times share an absolute anchor, the rest of the
+// block is varint gaps in units of the block's scale, and each transition
+// keeps a one-byte index into the distinct (offset, name, dst) types
+#define TRANSITION_BLOCK_LEN 8
+
+struct TZ_Transition_Blocks {
+	int64_t count;
+	int64_t block_count;
+	int64_t last_time;
+	int64_t *anchors;
+	uint32_t *offsets;
+	uint16_t *scales;
+	uint8_t *gaps;
+	uint8_t *types;
+	TZ_Record *type_records;
+	int64_t type_count;
+	size_t size;
+};
+
+static size_t varint_put(uint8_t *out, uint64_t v) {
+	size_t len = 0;
+	while (v >= 0x80) {
+		if (out != NULL) out[len] = (uint8_t)(v | 0x80);
+		v >>= 7;
+		len += 1;
+	}
+	if (out != NULL) out[len] = (uint8_t)v;
+	return len + 1;
+}
+
+static uint64_t varint_get(uint8_t **p) {
+	uint64_t v = 0;
+	int shift = 0;
+	uint8_t byte;
+	do {
+		byte = **p;
+		*p += 1;
+		v |= (uint64_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return v;
+}
+
+static void transition_blocks_free(TZ_Transition_Blocks *b) {
+	if (b == NULL) return;
+
+	free(b->anchors);
+	free(b->offsets);
+	free(b->scales);
+	free(b->gaps);
+	free(b->types);
+	free(b->type_records);
+	free(b);
+}
+
 bool tz_region_load(char *region_name, TZ_Region **region) {
 	return load_region(region_name, region);
 }
@@ -1224,6 +1982,30 @@ bool tz_region_load_from_buffer(uint8_t *buffer, size_t sz, char *reg_str, TZ_Re
 	return parse_tzif(buffer, sz, reg_str, region);
 }
 
+bool tz_region_load_from_fd(int fd, char *reg_str, TZ_Region **region) {
+	return load_tzif_fd(fd, reg_str, region);
+}
+
+bool tz_region_from_posix(char *posix_tz, TZ_Region **region) {
+	TZ_RRule rrule = {};
+	if (!tz_parse_posix_tz(posix_tz, (int)strlen(posix_tz), &rrule)) return false;
+
+	// UTC is a special case, we don't need to alloc
+	if (!rrule.has_dst && rrule.std_offset == 0 && !strcmp(rrule.std_name, "UTC")) {
+		*region = NULL;
+		return true;
+	}
+
+	TZ_Region *out_region = (TZ_Region *)malloc(sizeof(TZ_Region));
+	*out_region = (TZ_Region){
+		.kind  = region_kind(0, &rrule),
+		.name  = clonestr(posix_tz),
+		.rrule = rrule,
+	};
+	*region = out_region;
+	return true;
+}
+
 void tz_region_destroy(TZ_Region *region) {
 	if (region == NULL) return;
 
@@ -1232,12 +2014,15 @@ void tz_region_destroy(TZ_Region *region) {
 	}
 	free(region->shortnames);
 	free(region->records);
+	transition_blocks_free(region->blocks);
+	free(region->leapseconds);
+	free(region->days);
 	free(region->name);
 	free(region);
 }
 
-TZ_Date tz_get_date(TZ_Time t) {
-	uint64_t abs = (uint64_t)(t.time + UNIX_TO_ABSOLUTE);
+static TZ_Date time_to_date(int64_t time, int64_t *out_year_day) {
+	uint64_t abs = (uint64_t)(time + UNIX_TO_ABSOLUTE);
 	uint64_t d = abs / SECONDS_PER_DAY;
 
 	uint64_t n = d / DAYS_PER_400_YEARS;
@@ -1260,6 +2045,7 @@ TZ_Date tz_get_date(TZ_Time t) {
 
 	int64_t year = ((int64_t)y + ABSOLUTE_ZERO_YEAR);
 	int64_t year_day = (int64_t)d;
+	*out_year_day = year_day;
 
 	int64_t day = year_day;
 
@@ -1294,6 +2080,11 @@ TZ_Date tz_get_date(TZ_Time t) {
 	};
 }
 
+TZ_Date tz_get_date(TZ_Time t) {
+	int64_t year_day = 0;
+	return time_to_date(t.time, &year_day);
+}
+
 static int64_t trans_date_to_seconds(int64_t year, TZ_Transition_Date td) {
 	bool is_leap = is_leap_year(year);
 	int64_t t = year_to_time(year);
@@ -1337,6 +2128,29 @@ static int64_t trans_date_to_seconds(int64_t year, TZ_Transition_Date td) {
 	return 0;
 }
 
+static void rrule_year_records(TZ_RRule *rrule, int64_t year, TZ_Record records[2]) {
+	int64_t std_secs = trans_date_to_seconds(year, rrule->std_date);
+	int64_t dst_secs = trans_date_to_seconds(year, rrule->dst_date);
+
+	records[0] = (TZ_Record){
+		.time = std_secs,
+		.utc_offset = rrule->std_offset,
+		.shortname = rrule->std_name,
+		.dst = false,
+	};
+	records[1] = (TZ_Record){
+		.time = dst_secs,
+		.utc_offset = rrule->dst_offset,
+		.shortname = rrule->dst_name,
+		.dst = true,
+	};
+	if (records[0].time > records[1].time) {
+		TZ_Record tmp = records[0];
+		records[0] = records[1];
+		records[1] = tmp;
+	}
+}
+
 static TZ_Record process_rrule(TZ_RRule *rrule, int64_t cur) {
 	if (!rrule->has_dst) {
 		return (TZ_Record){
@@ -1348,28 +2162,8 @@ static TZ_Record process_rrule(TZ_RRule *rrule, int64_t cur) {
 	}
 
 	TZ_Date date = tz_get_date((TZ_Time){.time = cur, .tz = NULL});
-	int64_t std_secs = trans_date_to_seconds(date.year, rrule->std_date);
-	int64_t dst_secs = trans_date_to_seconds(date.year, rrule->dst_date);
-
-	TZ_Record records[] = {
-		{
-			.time = std_secs,
-			.utc_offset = rrule->std_offset,
-			.shortname = rrule->std_name,
-			.dst = false,
-		},
-		{
-			.time = dst_secs,
-			.utc_offset = rrule->dst_offset,
-			.shortname = rrule->dst_name,
-			.dst = true,
-		}
-	};
-	if (records[0].time > records[1].time) {
-		TZ_Record tmp = records[0];
-		records[0] = records[1];
-		records[1] = tmp;
-	}
+	TZ_Record records[2];
+	rrule_year_records(rrule, date.year, records);
 
 	for (int i = 0; i < 2; i++) {
 		TZ_Record record = records[i];
@@ -1381,33 +2175,394 @@ static TZ_Record process_rrule(TZ_RRule *rrule, int64_t cur) {
 	return records[0];
 }
 
-static TZ_Record region_get_nearest(TZ_Region *tz, int64_t tm) {
-	if (tz->record_count == 0) {
-		return process_rrule(&tz->rrule, tm);
+// Returns the index of the last record starting at or before tm,
+// or 0 if tm comes before every record
+static int64_t region_find_record(TZ_Region *tz, int64_t tm) {
+	int64_t left = 0;
+	int64_t right = tz->record_count;
+	while (left < right) {
+		int64_t mid = (int64_t)((uint64_t)(left + right) >> 1);
+		if (tz->records[mid].time <= tm) {
+			left = mid + 1;
+		} else {
+			right = mid;
+		}
 	}
 
-	int64_t n = tz->record_count;
-
-	int64_t tm_sec = tm;
-	int64_t last_time = tz->records[tz->record_count-1].time;
-	if (tm_sec > last_time) {
-		return process_rrule(&tz->rrule, tm);
-	}
+	return MAX(0, left - 1);
+}
 
+// Same contract as region_find_record, also handing back the start of the
+// transition found and the start of the one after it
+static int64_t transition_blocks_find(TZ_Transition_Blocks *b, int64_t tm, int64_t *start, int64_t *next) {
 	int64_t left = 0;
-	int64_t right = n;
+	int64_t right = b->block_count;
 	while (left < right) {
 		int64_t mid = (int64_t)((uint64_t)(left + right) >> 1);
-		if (tz->records[mid].time < tm_sec) {
+		if (b->anchors[mid] <= tm) {
 			left = mid + 1;
 		} else {
 			right = mid;
 		}
 	}
+	int64_t blk = MAX(0, left - 1);
+
+	int64_t len = MIN(TRANSITION_BLOCK_LEN, b->count - (blk * TRANSITION_BLOCK_LEN));
+	int64_t scale = b->scales[blk];
+	uint8_t *p = b->gaps + b->offsets[blk];
+
+	int64_t t = b->anchors[blk];
+	int64_t nt = (blk + 1 < b->block_count) ? b->anchors[blk + 1] : b->last_time + 1;
+	int64_t i = 0;
+	for (int64_t k = 1; k < len; k++) {
+		int64_t cand = t + ((int64_t)varint_get(&p) * scale);
+		if (cand > tm) {
+			nt = cand;
+			break;
+		}
+		t = cand;
+		i = k;
+	}
 
-	int64_t idx = MAX(0, left - 1);
-	TZ_Record ret = tz->records[idx];
-	return ret;
+	*start = t;
+	*next = nt;
+	return (blk * TRANSITION_BLOCK_LEN) + i;
+}
+
+static int64_t region_last_time(TZ_Region *tz) {
+	if (tz->blocks != NULL) {
+		return tz->blocks->last_time;
+	}
+	return tz->records[tz->record_count - 1].time;
+}
+
+// The record in effect at tm, along with the range it holds for; the
+// first record also covers everything before it
+static TZ_Record region_table_find(TZ_Region *tz, int64_t tm, int64_t *from, int64_t *until) {
+	int64_t idx;
+	TZ_Record record;
+	if (tz->blocks != NULL) {
+		TZ_Transition_Blocks *b = tz->blocks;
+		int64_t start;
+		idx = transition_blocks_find(b, tm, &start, until);
+		record = b->type_records[b->types[idx]];
+		record.time = start;
+	} else {
+		idx = region_find_record(tz, tm);
+		record = tz->records[idx];
+		*until = (idx + 1 < tz->record_count) ? tz->records[idx + 1].time : record.time + 1;
+	}
+
+	*from = (idx == 0) ? INT64_MIN : record.time;
+	return record;
+}
+
+bool tz_region_compress(TZ_Region *tz) {
+	if (tz == NULL || tz->blocks != NULL || tz->record_count == 0) {
+		return true;
+	}
+
+	static const int64_t scale_choices[] = {3600, 1800, 900, 60, 1};
+
+	int64_t n = tz->record_count;
+	TZ_Record *records = tz->records;
+	TZ_Transition_Blocks *b = (TZ_Transition_Blocks *)calloc(1, sizeof(TZ_Transition_Blocks));
+	if (b == NULL) {
+		return false;
+	}
+
+	b->count = n;
+	b->block_count = (n + TRANSITION_BLOCK_LEN - 1) / TRANSITION_BLOCK_LEN;
+	b->last_time = records[n - 1].time;
+	b->anchors = (int64_t *)malloc(b->block_count * sizeof(int64_t));
+	b->offsets = (uint32_t *)malloc(b->block_count * sizeof(uint32_t));
+	b->scales = (uint16_t *)malloc(b->block_count * sizeof(uint16_t));
+	b->types = (uint8_t *)malloc(n);
+	b->type_records = (TZ_Record *)malloc(256 * sizeof(TZ_Record));
+	if (b->anchors == NULL || b->offsets == NULL || b->scales == NULL || b->types == NULL || b->type_records == NULL) {
+		transition_blocks_free(b);
+		return false;
+	}
+
+	for (int64_t i = 0; i < n; i++) {
+		TZ_Record r = records[i];
+		int64_t type = 0;
+		while (type < b->type_count) {
+			TZ_Record *t = &b->type_records[type];
+			if (t->utc_offset == r.utc_offset && t->shortname == r.shortname && t->dst == r.dst) {
+				break;
+			}
+			type += 1;
+		}
+
+		if (type == b->type_count) {
+			if (type == 256) {
+				transition_blocks_free(b);
+				return false;
+			}
+			b->type_records[type] = (TZ_Record){.utc_offset = r.utc_offset, .shortname = r.shortname, .dst = r.dst};
+			b->type_count += 1;
+		}
+		b->types[i] = (uint8_t)type;
+	}
+
+	// First pass picks each block's scale and sizes the gaps, the second writes them
+	size_t gap_bytes = 0;
+	for (int64_t blk = 0; blk < b->block_count; blk++) {
+		int64_t first = blk * TRANSITION_BLOCK_LEN;
+		int64_t last = MIN(first + TRANSITION_BLOCK_LEN, n) - 1;
+
+		int64_t scale = 1;
+		for (size_t c = 0; c < ARR_LEN(scale_choices); c++) {
+			bool fits = true;
+			for (int64_t i = first + 1; i <= last; i++) {
+				int64_t gap = records[i].time - records[i - 1].time;
+				if (gap < 0) {
+					transition_blocks_free(b);
+					return false;
+				}
+				fits = fits && (gap % scale_choices[c] == 0);
+			}
+			if (fits) {
+				scale = scale_choices[c];
+				break;
+			}
+		}
+
+		b->anchors[blk] = records[first].time;
+		b->scales[blk] = (uint16_t)scale;
+		b->offsets[blk] = (uint32_t)gap_bytes;
+		for (int64_t i = first + 1; i <= last; i++) {
+			gap_bytes += varint_put(NULL, (uint64_t)((records[i].time - records[i - 1].time) / scale));
+		}
+	}
+
+	b->gaps = (uint8_t *)malloc(MAX(1, gap_bytes));
+	if (b->gaps == NULL) {
+		transition_blocks_free(b);
+		return false;
+	}
+	for (int64_t blk = 0; blk < b->block_count; blk++) {
+		int64_t first = blk * TRANSITION_BLOCK_LEN;
+		int64_t last = MIN(first + TRANSITION_BLOCK_LEN, n) - 1;
+		uint8_t *out = b->gaps + b->offsets[blk];
+		for (int64_t i = first + 1; i <= last; i++) {
+			out += varint_put(out, (uint64_t)((records[i].time - records[i - 1].time) / b->scales[blk]));
+		}
+	}
+
+	TZ_Record *type_records = (TZ_Record *)realloc(b->type_records, b->type_count * sizeof(TZ_Record));
+	if (type_records != NULL) {
+		b->type_records = type_records;
+	}
+
+	b->size = sizeof(TZ_Transition_Blocks) +
+		(b->block_count * (sizeof(int64_t) + sizeof(uint32_t) + sizeof(uint16_t))) +
+		gap_bytes + n + (b->type_count * sizeof(TZ_Record));
+
+	// Short tables with many types can come out bigger, those are left as they are
+	if (b->size >= n * sizeof(TZ_Record)) {
+		transition_blocks_free(b);
+		return true;
+	}
+
+	tz->blocks = b;
+	tz->records = NULL;
+	free(records);
+	return true;
+}
+
+size_t tz_region_table_size(TZ_Region *tz) {
+	if (tz == NULL) return 0;
+	if (tz->blocks != NULL) return tz->blocks->size;
+	return tz->record_count * sizeof(TZ_Record);
+}
+
+static TZ_Record region_get_nearest(TZ_Region *tz, int64_t tm) {
+	switch (tz->kind) {
+		case TZ_Region_Fixed: {
+			return (TZ_Record){
+				.time       = tm,
+				.utc_offset = tz->rrule.std_offset,
+				.shortname  = tz->rrule.std_name,
+				.dst        = false,
+			};
+		} break;
+		case TZ_Region_Rule: {
+			return process_rrule(&tz->rrule, tm);
+		} break;
+		case TZ_Region_Table: break;
+	}
+
+	if (tz->record_count == 0) {
+		return process_rrule(&tz->rrule, tm);
+	}
+
+	if (tm > region_last_time(tz)) {
+		return process_rrule(&tz->rrule, tm);
+	}
+
+	int64_t from, until;
+	return region_table_find(tz, tm, &from, &until);
+}
+
+// One entry per UTC day; switch_time is the second of the day the offset
+// changes at, or SECONDS_PER_DAY when it doesn't
+struct TZ_Day_Entry {
+	int32_t utc_offset;
+	int32_t switch_time;
+	int32_t switch_offset;
+};
+
+// Marks a day with more than one transition, which falls back to the records
+#define DAY_ENTRY_FALLBACK INT32_MIN
+
+// Offset-only lookups let fixed regions skip building a record at all
+static int64_t region_get_offset(TZ_Region *tz, int64_t tm) {
+	if (tz->kind == TZ_Region_Fixed) {
+		return tz->rrule.std_offset;
+	}
+
+	int64_t rel = tm - tz->day_base;
+	if (rel >= 0 && rel < tz->day_count * SECONDS_PER_DAY) {
+		int64_t day = rel / SECONDS_PER_DAY;
+		TZ_Day_Entry entry = tz->days[day];
+		if (entry.utc_offset != DAY_ENTRY_FALLBACK) {
+			return (rel - (day * SECONDS_PER_DAY) >= entry.switch_time) ? entry.switch_offset : entry.utc_offset;
+		}
+	}
+
+	return region_get_nearest(tz, tm).utc_offset;
+}
+
+static TZ_Lookup record_to_lookup(TZ_Record record, int64_t from, int64_t until) {
+	return (TZ_Lookup){
+		.utc_offset  = record.utc_offset,
+		.dst         = record.dst,
+		.shortname   = (record.shortname == NULL) ? (char *)"" : record.shortname,
+		.valid_from  = from,
+		.valid_until = until,
+	};
+}
+
+static TZ_Lookup rrule_get_span(TZ_RRule *rrule, int64_t tm) {
+	if (!rrule->has_dst) {
+		return record_to_lookup(process_rrule(rrule, tm), INT64_MIN, INT64_MAX);
+	}
+
+	TZ_Date date = tz_get_date((TZ_Time){.time = tm, .tz = NULL});
+	TZ_Record cur[2];
+	rrule_year_records(rrule, date.year, cur);
+
+	// Before the first change of the year, we're still in the tail of last year's rule
+	if (tm < cur[0].time) {
+		TZ_Record prev[2];
+		rrule_year_records(rrule, date.year - 1, prev);
+		return record_to_lookup(cur[0], prev[1].time, cur[0].time);
+	}
+	if (tm < cur[1].time) {
+		return record_to_lookup(cur[1], cur[0].time, cur[1].time);
+	}
+
+	TZ_Record next[2];
+	rrule_year_records(rrule, date.year + 1, next);
+	return record_to_lookup(cur[0], cur[1].time, next[0].time);
+}
+
+static TZ_Lookup region_get_span(TZ_Region *tz, int64_t tm) {
+	if (tz->kind != TZ_Region_Table || tz->record_count == 0) {
+		return rrule_get_span(&tz->rrule, tm);
+	}
+
+	int64_t last_time = region_last_time(tz);
+	if (tm > last_time) {
+		TZ_Lookup span = rrule_get_span(&tz->rrule, tm);
+		span.valid_from = MAX(span.valid_from, last_time + 1);
+		return span;
+	}
+
+	int64_t from, until;
+	TZ_Record record = region_table_find(tz, tm, &from, &until);
+	return record_to_lookup(record, from, until);
+}
+
+bool tz_region_build_day_table(TZ_Region *tz, int64_t from_year, int64_t to_year) {
+	if (tz == NULL || to_year < from_year) {
+		return false;
+	}
+
+	free(tz->days);
+	tz->days = NULL;
+	tz->day_count = 0;
+
+	// Fixed offsets are already a single load
+	if (tz->kind == TZ_Region_Fixed) {
+		return true;
+	}
+
+	int64_t base = year_to_time(from_year);
+	int64_t day_count = (year_to_time(to_year + 1) - year_to_time(from_year)) / SECONDS_PER_DAY;
+	TZ_Day_Entry *days = (TZ_Day_Entry *)malloc(day_count * sizeof(TZ_Day_Entry));
+	if (days == NULL) {
+		return false;
+	}
+
+	TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+	for (int64_t i = 0; i < day_count; i++) {
+		int64_t start = base + (i * SECONDS_PER_DAY);
+		int64_t end = start + SECONDS_PER_DAY;
+		if (start < span.valid_from || start >= span.valid_until) {
+			span = region_get_span(tz, start);
+		}
+
+		TZ_Day_Entry entry = {
+			.utc_offset    = (int32_t)span.utc_offset,
+			.switch_time   = SECONDS_PER_DAY,
+			.switch_offset = (int32_t)span.utc_offset,
+		};
+		if (span.valid_until < end) {
+			int64_t switch_at = span.valid_until;
+			span = region_get_span(tz, switch_at);
+			if (span.valid_until < end) {
+				entry.utc_offset = DAY_ENTRY_FALLBACK;
+			} else {
+				entry.switch_time = (int32_t)(switch_at - start);
+				entry.switch_offset = (int32_t)span.utc_offset;
+			}
+		}
+		days[i] = entry;
+	}
+
+	tz->days = days;
+	tz->day_base = base;
+	tz->day_count = day_count;
+	return true;
+}
+
+void tz_lookup(TZ_Region *tz, int64_t utc, TZ_Lookup *info) {
+	if (tz == NULL) {
+		*info = (TZ_Lookup){
+			.utc_offset  = 0,
+			.dst         = false,
+			.shortname   = (char *)"UTC",
+			.valid_from  = INT64_MIN,
+			.valid_until = INT64_MAX,
+		};
+		return;
+	}
+
+	*info = region_get_span(tz, utc);
+}
+
+void tz_convert_batch(TZ_Region *tz, int64_t *utc, int64_t *local, int64_t count) {
+	TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+	for (int64_t i = 0; i < count; i++) {
+		int64_t t = utc[i];
+		if (t < span.valid_from || t >= span.valid_until) {
+			tz_lookup(tz, t, &span);
+		}
+		local[i] = t + span.utc_offset;
+	}
 }
 
 TZ_Time tz_time_from_unix_seconds(int64_t time) {
@@ -1433,8 +2588,7 @@ TZ_Time tz_time_to_utc(TZ_Time t) {
 		return t;
 	}
 
-	TZ_Record record = region_get_nearest(t.tz, t.time);
-	return (TZ_Time){.time = t.time - record.utc_offset, .tz = NULL};
+	return (TZ_Time){.time = t.time - region_get_offset(t.tz, t.time), .tz = NULL};
 }
 
 int64_t tz_time_to_unix_seconds(TZ_Time t) {
@@ -1454,8 +2608,7 @@ TZ_Time tz_time_to_tz(TZ_Time in_t, TZ_Region *tz) {
 		return t;
 	}
 
-	TZ_Record record = region_get_nearest(tz, t.time);
-	return (TZ_Time){.time = t.time + record.utc_offset, .tz = tz};
+	return (TZ_Time){.time = t.time + region_get_offset(tz, t.time), .tz = tz};
 }
 
 char *tz_shortname(TZ_Time t) {
@@ -1483,3 +2636,4383 @@ TZ_HMS tz_get_hms(TZ_Time t) {
 
 	return (TZ_HMS){.hours = (int8_t)hours, .minutes = (int8_t)mins, .seconds = (int8_t)secs};
 }
+
+void tz_breakdown(TZ_Time t, TZ_Breakdown *out) {
+	int64_t days = floor_div(t.time, SECONDS_PER_DAY);
+	int64_t secs = t.time - (days * SECONDS_PER_DAY);
+
+	int64_t year_day = 0;
+	out->date = time_to_date(t.time, &year_day);
+	out->year_day = (int16_t)year_day;
+	out->weekday = (int8_t)floor_mod(days + 4, 7);
+	out->hms = (TZ_HMS){
+		.hours   = (int8_t)(secs / SECONDS_PER_HOUR),
+		.minutes = (int8_t)((secs / SECONDS_PER_MINUTE) % 60),
+		.seconds = (int8_t)(secs % 60),
+	};
+
+	if (t.tz == NULL) {
+		out->utc_offset = 0;
+		out->dst = false;
+		out->shortname = (char *)"UTC";
+		return;
+	}
+
+	TZ_Record record = region_get_nearest(t.tz, t.time);
+	out->utc_offset = record.utc_offset;
+	out->dst = record.dst;
+	out->shortname = (record.shortname == NULL) ? (char *)"" : record.shortname;
+}
+
+// SECTION: Zone Name Index
+typedef struct {
+	char *name;
+	int32_t zone_id;
+} Zone_Slot;
+
+// A CHD-style minimal perfect hash: every name hashes to a bucket, and each
+// bucket stores the seed that scatters its names into free slots
+struct TZ_Zone_Index {
+	Zone_Slot *slots;
+	int64_t slot_count;
+	uint32_t *seeds;
+	int64_t bucket_count;
+	char **zone_names;
+	int32_t zone_count;
+};
+
+#define MAX_ALIAS_DEPTH 8
+#define MAX_BUCKET_SEED (1u << 24)
+
+static uint8_t ascii_lower(uint8_t ch) {
+	return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+static int ascii_casecmp(char *a, char *b) {
+	for (;; a++, b++) {
+		uint8_t ca = ascii_lower((uint8_t)*a);
+		uint8_t cb = ascii_lower((uint8_t)*b);
+		if (ca != cb || ca == 0) {
+			return (int)ca - (int)cb;
+		}
+	}
+}
+
+static uint64_t hash_name(char *name) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (; *name; name++) {
+		h = (h ^ ascii_lower((uint8_t)*name)) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static uint64_t hash_slot(uint64_t h, uint32_t seed, int64_t slot_count) {
+	uint64_t x = h + ((uint64_t)seed * 0x9e3779b97f4a7c15ull);
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x % (uint64_t)slot_count;
+}
+
+static int zone_name_cmp(const void *a, const void *b) {
+	Zone_Name *za = (Zone_Name *)a;
+	Zone_Name *zb = (Zone_Name *)b;
+	int ret = ascii_casecmp(za->name, zb->name);
+	if (ret != 0) {
+		return ret;
+	}
+
+	return (za->seq > zb->seq) - (za->seq < zb->seq);
+}
+
+static Zone_Name *find_zone_name(Zone_Name *names, int64_t count, char *name) {
+	int64_t lo = 0;
+	int64_t hi = count;
+	while (lo < hi) {
+		int64_t mid = lo + ((hi - lo) / 2);
+		int ret = ascii_casecmp(names[mid].name, name);
+		if (ret == 0) {
+			return &names[mid];
+		}
+		if (ret < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+typedef struct {
+	int64_t bucket;
+	int64_t start;
+	int64_t count;
+} Hash_Bucket;
+
+static int hash_bucket_cmp(const void *a, const void *b) {
+	Hash_Bucket *ba = (Hash_Bucket *)a;
+	Hash_Bucket *bb = (Hash_Bucket *)b;
+	if (ba->count != bb->count) {
+		return (ba->count < bb->count) ? 1 : -1;
+	}
+	return (ba->bucket > bb->bucket) - (ba->bucket < bb->bucket);
+}
+
+static bool build_perfect_hash(TZ_Zone_Index *index, Zone_Name *names, int64_t count) {
+	int64_t slot_count = count;
+	int64_t bucket_count = (count / 4) + 1;
+
+	uint64_t *hashes = malloc(count * sizeof(uint64_t));
+	int64_t *order = malloc(count * sizeof(int64_t));
+	Hash_Bucket *buckets = calloc(bucket_count, sizeof(Hash_Bucket));
+	bool *taken = calloc(slot_count, sizeof(bool));
+	int64_t *scratch = malloc(count * sizeof(int64_t));
+	index->seeds = calloc(bucket_count, sizeof(uint32_t));
+	index->slots = calloc(slot_count, sizeof(Zone_Slot));
+
+	bool ok = hashes && order && buckets && taken && scratch && index->seeds && index->slots;
+	if (!ok) {
+		goto exit_func;
+	}
+	index->slot_count = slot_count;
+	index->bucket_count = bucket_count;
+
+	// Counting sort the names into their buckets
+	for (int64_t i = 0; i < bucket_count; i++) {
+		buckets[i].bucket = i;
+	}
+	for (int64_t i = 0; i < count; i++) {
+		hashes[i] = hash_name(names[i].name);
+		buckets[hashes[i] % bucket_count].count += 1;
+	}
+	int64_t start = 0;
+	for (int64_t i = 0; i < bucket_count; i++) {
+		buckets[i].start = start;
+		start += buckets[i].count;
+		buckets[i].count = 0;
+	}
+	for (int64_t i = 0; i < count; i++) {
+		Hash_Bucket *b = &buckets[hashes[i] % bucket_count];
+		order[b->start + b->count] = i;
+		b->count += 1;
+	}
+
+	// Place the biggest buckets first, while most slots are still free
+	qsort(buckets, bucket_count, sizeof(Hash_Bucket), hash_bucket_cmp);
+	for (int64_t i = 0; i < bucket_count && buckets[i].count > 0; i++) {
+		Hash_Bucket *b = &buckets[i];
+
+		uint32_t seed = 1;
+		for (; seed < MAX_BUCKET_SEED; seed++) {
+			int64_t placed = 0;
+			for (; placed < b->count; placed++) {
+				int64_t slot = (int64_t)hash_slot(hashes[order[b->start + placed]], seed, slot_count);
+				if (taken[slot]) {
+					break;
+				}
+				taken[slot] = true;
+				scratch[placed] = slot;
+			}
+			if (placed == b->count) {
+				break;
+			}
+
+			for (int64_t j = 0; j < placed; j++) {
+				taken[scratch[j]] = false;
+			}
+		}
+		if (seed == MAX_BUCKET_SEED) {
+			ok = false;
+			goto exit_func;
+		}
+
+		index->seeds[b->bucket] = seed;
+		for (int64_t j = 0; j < b->count; j++) {
+			Zone_Name *name = &names[order[b->start + j]];
+			index->slots[scratch[j]] = (Zone_Slot){.name = name->name, .zone_id = name->zone_id};
+			if (name->target == NULL) {
+				index->zone_names[name->zone_id] = name->name;
+			}
+			name->name = NULL;
+		}
+	}
+
+exit_func:
+	free(hashes);
+	free(order);
+	free(buckets);
+	free(taken);
+	free(scratch);
+	return ok;
+}
+
+void tz_zone_index_destroy(TZ_Zone_Index *index) {
+	if (index == NULL) return;
+
+	if (index->slots != NULL) {
+		for (int64_t i = 0; i < index->slot_count; i++) {
+			free(index->slots[i].name);
+		}
+	}
+	free(index->slots);
+	free(index->seeds);
+	free(index->zone_names);
+	free(index);
+}
+
+bool tz_zone_index_build(char *zoneinfo_dir, TZ_Zone_Index **out_index) {
+	Zone_Name_List list = {0};
+	TZ_Zone_Index *index = NULL;
+	bool success = false;
+
+	if (!collect_zone_names(zoneinfo_dir, &list)) {
+		goto free_names;
+	}
+
+	// Sort case-insensitively and drop repeats, the first spelling of a name wins
+	qsort(list.names, list.len, sizeof(Zone_Name), zone_name_cmp);
+	int64_t count = 0;
+	for (int64_t i = 0; i < list.len; i++) {
+		if (count > 0 && ascii_casecmp(list.names[count - 1].name, list.names[i].name) == 0) {
+			free(list.names[i].name);
+			free(list.names[i].target);
+			continue;
+		}
+		list.names[count++] = list.names[i];
+	}
+	list.len = count;
+
+	// Zone ids follow the sorted order of canonical names, so they only change when the tzdb does
+	int32_t zone_count = 0;
+	for (int64_t i = 0; i < count; i++) {
+		if (list.names[i].target == NULL) {
+			list.names[i].zone_id = zone_count++;
+		}
+	}
+
+	for (int64_t i = 0; i < count; i++) {
+		Zone_Name *name = &list.names[i];
+		for (int depth = 0; name != NULL && name->target != NULL && depth < MAX_ALIAS_DEPTH; depth++) {
+			name = find_zone_name(list.names, count, name->target);
+		}
+		if (name != NULL && name->target == NULL) {
+			list.names[i].zone_id = name->zone_id;
+		}
+	}
+
+	// Links that lead nowhere can't be looked up
+	int64_t kept = 0;
+	for (int64_t i = 0; i < count; i++) {
+		if (list.names[i].zone_id < 0) {
+			free(list.names[i].name);
+			free(list.names[i].target);
+			continue;
+		}
+		list.names[kept++] = list.names[i];
+	}
+	list.len = kept;
+
+	index = calloc(1, sizeof(TZ_Zone_Index));
+	if (index == NULL) {
+		goto free_names;
+	}
+	index->zone_count = zone_count;
+	index->zone_names = calloc(zone_count, sizeof(char *));
+	if (index->zone_names == NULL) {
+		goto free_index;
+	}
+
+	if (!build_perfect_hash(index, list.names, list.len)) {
+		goto free_index;
+	}
+
+	*out_index = index;
+	success = true;
+	goto free_names;
+
+free_index:
+	tz_zone_index_destroy(index);
+free_names:
+	for (int64_t i = 0; i < list.len; i++) {
+		free(list.names[i].name);
+		free(list.names[i].target);
+	}
+	free(list.names);
+	return success;
+}
+
+bool tz_zone_index_find(TZ_Zone_Index *index, char *name, int32_t *zone_id) {
+	if (index->slot_count == 0) {
+		return false;
+	}
+
+	uint64_t h = hash_name(name);
+	uint32_t seed = index->seeds[h % (uint64_t)index->bucket_count];
+	Zone_Slot *slot = &index->slots[hash_slot(h, seed, index->slot_count)];
+	if (ascii_casecmp(slot->name, name) != 0) {
+		return false;
+	}
+
+	*zone_id = slot->zone_id;
+	return true;
+}
+
+char *tz_zone_index_name(TZ_Zone_Index *index, int32_t zone_id) {
+	if (zone_id < 0 || zone_id >= index->zone_count) {
+		return NULL;
+	}
+	return index->zone_names[zone_id];
+}
+
+int32_t tz_zone_index_count(TZ_Zone_Index *index) {
+	return index->zone_count;
+}
+
+// SECTION: Abbreviation Index
+// Maps shortnames back to the zones and offsets that used them. A zone's uses of one
+// name at one offset get bridged across the gaps between seasons, so "PDT" still
+// resolves in January, and each name keeps a short timeline of what it meant when
+typedef struct {
+	int64_t from; // holds until the next meaning's from
+	int64_t utc_offset;
+	bool dst;
+} Abbrev_Meaning;
+
+typedef struct {
+	char *name;
+	int32_t name_len;
+	uint64_t hash;
+	Abbrev_Meaning *meanings;
+	int64_t meaning_count;
+	TZ_Abbrev_Match *matches; // sorted by zone, then time
+	int64_t match_count;
+} Abbrev_Entry;
+
+struct TZ_Abbrev_Index {
+	Abbrev_Entry *entries;
+	int64_t entry_count;
+	int32_t *slots; // entry indices, -1 is empty
+	uint64_t slot_mask;
+};
+
+typedef struct {
+	char *name;
+	TZ_Abbrev_Match match;
+} Abbrev_Range;
+
+typedef struct {
+	Abbrev_Range *ranges;
+	int64_t len;
+	int64_t cap;
+} Abbrev_Range_List;
+
+// Gaps up to this long between two uses of a name by one zone are summer or winter
+#define ABBREV_BRIDGE (400 * SECONDS_PER_DAY)
+
+static uint64_t hash_abbrev(char *name, int32_t len) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (int32_t i = 0; i < len; i++) {
+		h = (h ^ ascii_lower((uint8_t)name[i])) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static bool abbrev_range_push(Abbrev_Range_List *list, char *name, TZ_Region *tz, int64_t zone, int64_t utc_offset, bool dst, int64_t from, int64_t until) {
+	if (list->len + 1 > list->cap) {
+		list->cap = MAX(256, list->cap * 2);
+		Abbrev_Range *ranges = (Abbrev_Range *)realloc(list->ranges, list->cap * sizeof(Abbrev_Range));
+		if (ranges == NULL) {
+			return false;
+		}
+		list->ranges = ranges;
+	}
+	list->ranges[list->len++] = (Abbrev_Range){
+		.name  = name,
+		.match = {.tz = tz, .zone = zone, .utc_offset = utc_offset, .dst = dst, .valid_from = from, .valid_until = until},
+	};
+	return true;
+}
+
+// The table's spans, then whatever names the footer hands out forever after
+static bool abbrev_collect_zone(Abbrev_Range_List *list, TZ_Region *tz, int64_t zone) {
+	if (tz == NULL) {
+		return abbrev_range_push(list, (char *)"UTC", NULL, zone, 0, false, INT64_MIN, INT64_MAX);
+	}
+
+	int64_t footer_from = INT64_MIN;
+	if (tz->kind == TZ_Region_Table && tz->record_count > 0) {
+		int64_t last_time = region_last_time(tz);
+		int64_t t = INT64_MIN;
+		while (t <= last_time) {
+			int64_t from, until;
+			TZ_Record record = region_table_find(tz, t, &from, &until);
+			if (!abbrev_range_push(list, record.shortname, tz, zone, record.utc_offset, record.dst, from, until)) {
+				return false;
+			}
+			t = until;
+		}
+		footer_from = last_time + 1;
+	}
+
+	TZ_RRule *rrule = &tz->rrule;
+	if (rrule->std_name[0] != '\0' && !abbrev_range_push(list, rrule->std_name, tz, zone, rrule->std_offset, false, footer_from, INT64_MAX)) {
+		return false;
+	}
+	if (rrule->has_dst && rrule->dst_name[0] != '\0' && !abbrev_range_push(list, rrule->dst_name, tz, zone, rrule->dst_offset, true, footer_from, INT64_MAX)) {
+		return false;
+	}
+	return true;
+}
+
+static int abbrev_range_cmp(const void *a, const void *b) {
+	Abbrev_Range *ra = (Abbrev_Range *)a;
+	Abbrev_Range *rb = (Abbrev_Range *)b;
+	int ret = ascii_casecmp(ra->name, rb->name);
+	if (ret != 0) {
+		return ret;
+	}
+	if (ra->match.zone != rb->match.zone) {
+		return (ra->match.zone > rb->match.zone) - (ra->match.zone < rb->match.zone);
+	}
+	if (ra->match.utc_offset != rb->match.utc_offset) {
+		return (ra->match.utc_offset > rb->match.utc_offset) - (ra->match.utc_offset < rb->match.utc_offset);
+	}
+	if (ra->match.dst != rb->match.dst) {
+		return (int)ra->match.dst - (int)rb->match.dst;
+	}
+	return (ra->match.valid_from > rb->match.valid_from) - (ra->match.valid_from < rb->match.valid_from);
+}
+
+typedef struct {
+	int64_t time;
+	int64_t key;
+	int64_t delta;
+} Abbrev_Event;
+
+static int abbrev_event_cmp(const void *a, const void *b) {
+	int64_t ta = ((Abbrev_Event *)a)->time;
+	int64_t tb = ((Abbrev_Event *)b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+static bool abbrev_uses_equal(TZ_Abbrev_Match *a, TZ_Abbrev_Match *b, int64_t count) {
+	for (int64_t i = 0; i < count; i++) {
+		if (a[i].utc_offset != b[i].utc_offset || a[i].dst != b[i].dst || a[i].valid_from != b[i].valid_from || a[i].valid_until != b[i].valid_until) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// A name means whichever offset most zones were using it for at the time, ties going to the
+// offset of the earliest zone in the build list; between uses it keeps its last meaning.
+// Zones that used the name exactly like an earlier zone did (links, mostly) only count once
+static bool abbrev_build_meanings(Abbrev_Entry *entry) {
+	TZ_Abbrev_Match *matches = entry->matches;
+	int64_t count = entry->match_count;
+
+	// Distinct (offset, dst) pairs, with the first zone that used each
+	int64_t key_count = 0;
+	TZ_Abbrev_Match *keys = (TZ_Abbrev_Match *)malloc(count * sizeof(TZ_Abbrev_Match));
+	int64_t *active = (int64_t *)calloc(count, sizeof(int64_t));
+	Abbrev_Event *events = (Abbrev_Event *)malloc(2 * count * sizeof(Abbrev_Event));
+	entry->meanings = (Abbrev_Meaning *)malloc((2 * count + 1) * sizeof(Abbrev_Meaning));
+	if (keys == NULL || active == NULL || events == NULL || entry->meanings == NULL) {
+		free(keys);
+		free(active);
+		free(events);
+		return false;
+	}
+
+	int64_t event_count = 0;
+	for (int64_t start = 0; start < count;) {
+		int64_t end = start + 1;
+		while (end < count && matches[end].zone == matches[start].zone) {
+			end += 1;
+		}
+
+		bool copy = false;
+		for (int64_t prev = 0; prev < start && !copy;) {
+			int64_t prev_end = prev + 1;
+			while (prev_end < start && matches[prev_end].zone == matches[prev].zone) {
+				prev_end += 1;
+			}
+			copy = (prev_end - prev == end - start) && abbrev_uses_equal(&matches[prev], &matches[start], end - start);
+			prev = prev_end;
+		}
+
+		for (int64_t i = start; i < end && !copy; i++) {
+			int64_t k = 0;
+			for (; k < key_count; k++) {
+				if (keys[k].utc_offset == matches[i].utc_offset && keys[k].dst == matches[i].dst) {
+					break;
+				}
+			}
+			if (k == key_count) {
+				keys[key_count++] = matches[i];
+			}
+			events[event_count++] = (Abbrev_Event){.time = matches[i].valid_from, .key = k, .delta = 1};
+			events[event_count++] = (Abbrev_Event){.time = matches[i].valid_until, .key = k, .delta = -1};
+		}
+		start = end;
+	}
+	qsort(events, event_count, sizeof(Abbrev_Event), abbrev_event_cmp);
+
+	int64_t meaning_count = 0;
+	int64_t current = -1;
+	for (int64_t i = 0; i < event_count;) {
+		int64_t time = events[i].time;
+		for (; i < event_count && events[i].time == time; i++) {
+			active[events[i].key] += events[i].delta;
+		}
+
+		int64_t best = -1;
+		for (int64_t k = 0; k < key_count; k++) {
+			if (active[k] > 0 && (best < 0 || active[k] > active[best] || (active[k] == active[best] && keys[k].zone < keys[best].zone))) {
+				best = k;
+			}
+		}
+		if (best < 0 || best == current) {
+			continue;
+		}
+
+		entry->meanings[meaning_count++] = (Abbrev_Meaning){
+			.from       = (meaning_count == 0) ? INT64_MIN : time,
+			.utc_offset = keys[best].utc_offset,
+			.dst        = keys[best].dst,
+		};
+		current = best;
+	}
+	entry->meaning_count = meaning_count;
+
+	free(keys);
+	free(active);
+	free(events);
+	return true;
+}
+
+void tz_abbrev_index_destroy(TZ_Abbrev_Index *index) {
+	if (index == NULL) return;
+
+	for (int64_t i = 0; i < index->entry_count; i++) {
+		free(index->entries[i].name);
+		free(index->entries[i].meanings);
+		free(index->entries[i].matches);
+	}
+	free(index->entries);
+	free(index->slots);
+	free(index);
+}
+
+bool tz_abbrev_index_build(TZ_Region **zones, int64_t count, TZ_Abbrev_Index **out_index) {
+	Abbrev_Range_List list = {0};
+	TZ_Abbrev_Index *index = (TZ_Abbrev_Index *)calloc(1, sizeof(TZ_Abbrev_Index));
+	if (index == NULL) {
+		return false;
+	}
+
+	for (int64_t i = 0; i < count; i++) {
+		if (!abbrev_collect_zone(&list, zones[i], i)) {
+			goto fail;
+		}
+	}
+	qsort(list.ranges, list.len, sizeof(Abbrev_Range), abbrev_range_cmp);
+
+	// Bridge each zone's seasonal gaps, ranges for one name / zone / offset are next to each other now
+	int64_t merged = 0;
+	for (int64_t i = 0; i < list.len; i++) {
+		Abbrev_Range *cur = &list.ranges[i];
+		Abbrev_Range *prev = (merged > 0) ? &list.ranges[merged - 1] : NULL;
+		if (prev != NULL && ascii_casecmp(prev->name, cur->name) == 0 && prev->match.zone == cur->match.zone &&
+		    prev->match.utc_offset == cur->match.utc_offset && prev->match.dst == cur->match.dst &&
+		    (prev->match.valid_until == INT64_MAX || cur->match.valid_from <= prev->match.valid_until + ABBREV_BRIDGE)) {
+			prev->match.valid_until = MAX(prev->match.valid_until, cur->match.valid_until);
+			continue;
+		}
+		list.ranges[merged++] = *cur;
+	}
+	list.len = merged;
+
+	int64_t entry_cap = 0;
+	for (int64_t i = 0; i < list.len;) {
+		int64_t end = i + 1;
+		while (end < list.len && ascii_casecmp(list.ranges[i].name, list.ranges[end].name) == 0) {
+			end += 1;
+		}
+
+		if (index->entry_count + 1 > entry_cap) {
+			entry_cap = MAX(64, entry_cap * 2);
+			Abbrev_Entry *entries = (Abbrev_Entry *)realloc(index->entries, entry_cap * sizeof(Abbrev_Entry));
+			if (entries == NULL) {
+				goto fail;
+			}
+			index->entries = entries;
+		}
+		Abbrev_Entry *entry = &index->entries[index->entry_count++];
+		*entry = (Abbrev_Entry){
+			.name        = clonestr(list.ranges[i].name),
+			.name_len    = (int32_t)strlen(list.ranges[i].name),
+			.matches     = (TZ_Abbrev_Match *)malloc((end - i) * sizeof(TZ_Abbrev_Match)),
+			.match_count = end - i,
+		};
+		entry->hash = hash_abbrev(entry->name, entry->name_len);
+		if (entry->matches == NULL) {
+			goto fail;
+		}
+		for (int64_t j = i; j < end; j++) {
+			entry->matches[j - i] = list.ranges[j].match;
+		}
+		if (!abbrev_build_meanings(entry)) {
+			goto fail;
+		}
+		i = end;
+	}
+
+	uint64_t slot_count = 16;
+	while (slot_count < (uint64_t)index->entry_count * 2) {
+		slot_count *= 2;
+	}
+	index->slot_mask = slot_count - 1;
+	index->slots = (int32_t *)malloc(slot_count * sizeof(int32_t));
+	if (index->slots == NULL) {
+		goto fail;
+	}
+	memset(index->slots, 0xFF, slot_count * sizeof(int32_t));
+	for (int64_t i = 0; i < index->entry_count; i++) {
+		uint64_t slot = index->entries[i].hash & index->slot_mask;
+		while (index->slots[slot] >= 0) {
+			slot = (slot + 1) & index->slot_mask;
+		}
+		index->slots[slot] = (int32_t)i;
+	}
+
+	free(list.ranges);
+	*out_index = index;
+	return true;
+
+fail:
+	free(list.ranges);
+	tz_abbrev_index_destroy(index);
+	return false;
+}
+
+static Abbrev_Entry *abbrev_find(TZ_Abbrev_Index *index, char *abbrev, int abbrev_len) {
+	uint64_t h = hash_abbrev(abbrev, abbrev_len);
+	for (uint64_t slot = h & index->slot_mask; index->slots[slot] >= 0; slot = (slot + 1) & index->slot_mask) {
+		Abbrev_Entry *entry = &index->entries[index->slots[slot]];
+		if (entry->hash != h || entry->name_len != abbrev_len) {
+			continue;
+		}
+
+		int i = 0;
+		for (; i < abbrev_len && ascii_lower((uint8_t)entry->name[i]) == ascii_lower((uint8_t)abbrev[i]); i++) {}
+		if (i == abbrev_len) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+bool tz_abbrev_offset(TZ_Abbrev_Index *index, char *abbrev, int abbrev_len, int64_t approx_utc, int64_t *utc_offset, bool *dst) {
+	Abbrev_Entry *entry = abbrev_find(index, abbrev, abbrev_len);
+	if (entry == NULL || entry->meaning_count == 0) {
+		return false;
+	}
+
+	// Almost every name has only ever meant one thing
+	Abbrev_Meaning *meaning = &entry->meanings[entry->meaning_count - 1];
+	if (approx_utc < meaning->from) {
+		int64_t lo = 0;
+		int64_t hi = entry->meaning_count - 1;
+		while (lo < hi) {
+			int64_t mid = lo + ((hi - lo + 1) / 2);
+			if (entry->meanings[mid].from <= approx_utc) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		meaning = &entry->meanings[lo];
+	}
+
+	*utc_offset = meaning->utc_offset;
+	*dst = meaning->dst;
+	return true;
+}
+
+int64_t tz_abbrev_candidates(TZ_Abbrev_Index *index, char *abbrev, int abbrev_len, int64_t approx_utc, TZ_Abbrev_Match *matches, int64_t cap) {
+	Abbrev_Entry *entry = abbrev_find(index, abbrev, abbrev_len);
+	if (entry == NULL) {
+		return 0;
+	}
+
+	int64_t found = 0;
+	for (int64_t i = 0; i < entry->match_count; i++) {
+		TZ_Abbrev_Match *match = &entry->matches[i];
+		if (approx_utc < match->valid_from || approx_utc >= match->valid_until) {
+			continue;
+		}
+		if (found < cap) {
+			matches[found] = *match;
+		}
+		found += 1;
+	}
+	return found;
+}
+
+// SECTION: Background Loading
+typedef struct Load_Waiter {
+	TZ_Load_Fn fn;
+	void *user;
+	struct Load_Waiter *next;
+} Load_Waiter;
+
+typedef enum {
+	Cache_Pending,
+	Cache_Loaded,
+	Cache_Failed,
+} Cache_State;
+
+typedef struct Cache_Entry {
+	char *name;
+	Cache_State state;
+	TZ_Region *region;
+	Load_Waiter *waiters;
+	struct Cache_Entry *next_queued;
+} Cache_Entry;
+
+typedef struct Cache_Table {
+	Cache_Entry **slots;
+	int64_t cap;
+	struct Cache_Table *retired; // the table this one replaced
+} Cache_Table;
+
+// Everything below is guarded by cache_lock; the loader thread only drops it
+// while it's reading and parsing a file. tz_region_cached reads the table and
+// entry states without the lock, so those are written with atomic stores, and
+// tables that got grown out of stay around for readers still probing them
+static Mutex cache_lock = MUTEX_INITIALIZER;
+static Cond cache_wake = COND_INITIALIZER;
+static Cache_Table *cache_table = NULL;
+static int64_t cache_len = 0;
+static Cache_Entry *load_queue_head = NULL;
+static Cache_Entry *load_queue_tail = NULL;
+
+static Once_Flag loader_once = ONCE_FLAG_INITIALIZER;
+static bool loader_running = false;
+
+static Cache_Entry **cache_slot(Cache_Table *table, char *name) {
+	uint64_t i = hash_name(name) % (uint64_t)table->cap;
+	for (;; i = (i + 1) % (uint64_t)table->cap) {
+		Cache_Entry *entry = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+		if (entry == NULL || strcmp(entry->name, name) == 0) {
+			return &table->slots[i];
+		}
+	}
+}
+
+static Cache_Entry *cache_find(char *name) {
+	Cache_Table *table = __atomic_load_n(&cache_table, __ATOMIC_ACQUIRE);
+	if (table == NULL) {
+		return NULL;
+	}
+	return __atomic_load_n(cache_slot(table, name), __ATOMIC_ACQUIRE);
+}
+
+static Cache_Entry *cache_insert(char *name) {
+	Cache_Table *table = cache_table;
+	if (table == NULL || (cache_len + 1) * 2 > table->cap) {
+		Cache_Table *grown = calloc(1, sizeof(Cache_Table));
+		if (grown == NULL) {
+			return NULL;
+		}
+		grown->cap = MAX(64, (table != NULL) ? table->cap * 2 : 0);
+		grown->slots = calloc(grown->cap, sizeof(Cache_Entry *));
+		if (grown->slots == NULL) {
+			free(grown);
+			return NULL;
+		}
+		for (int64_t i = 0; table != NULL && i < table->cap; i++) {
+			if (table->slots[i] != NULL) {
+				*cache_slot(grown, table->slots[i]->name) = table->slots[i];
+			}
+		}
+		grown->retired = table;
+		__atomic_store_n(&cache_table, grown, __ATOMIC_RELEASE);
+		table = grown;
+	}
+
+	Cache_Entry *entry = calloc(1, sizeof(Cache_Entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->name = clonestr(name);
+	entry->state = Cache_Pending;
+
+	__atomic_store_n(cache_slot(table, name), entry, __ATOMIC_RELEASE);
+	cache_len += 1;
+	return entry;
+}
+
+static void loader_thread(void *arg) {
+	mutex_lock(&cache_lock);
+	for (;;) {
+		while (load_queue_head == NULL) {
+			cond_wait(&cache_wake, &cache_lock);
+		}
+
+		Cache_Entry *entry = load_queue_head;
+		load_queue_head = entry->next_queued;
+		if (load_queue_head == NULL) {
+			load_queue_tail = NULL;
+		}
+		entry->next_queued = NULL;
+
+		// The name is never freed and nobody else touches a pending entry, so it's safe to read unlocked
+		mutex_unlock(&cache_lock);
+		TZ_Region *region = NULL;
+		bool ok = load_region(entry->name, &region);
+		if (!ok) {
+			region = NULL;
+		}
+		mutex_lock(&cache_lock);
+
+		entry->region = region;
+		__atomic_store_n(&entry->state, ok ? Cache_Loaded : Cache_Failed, __ATOMIC_RELEASE);
+		Load_Waiter *waiters = entry->waiters;
+		entry->waiters = NULL;
+
+		mutex_unlock(&cache_lock);
+		while (waiters != NULL) {
+			Load_Waiter *next = waiters->next;
+			waiters->fn(waiters->user, entry->name, region, ok);
+			free(waiters);
+			waiters = next;
+		}
+		mutex_lock(&cache_lock);
+	}
+}
+
+// The loader runs for the life of the process, nothing ever joins it
+static void start_loader(void) {
+	Thread thread;
+	loader_running = thread_start(&thread, loader_thread, NULL);
+	if (loader_running) {
+		thread_detach(thread);
+	}
+}
+
+// Called with cache_lock held; returns the entry, queueing a load the first time a name is asked
+// for. Failures stay cached, so asking again for a name that doesn't exist never touches the disk
+static Cache_Entry *cache_request(char *name) {
+	Cache_Entry *entry = cache_find(name);
+	if (entry == NULL) {
+		entry = cache_insert(name);
+		if (entry == NULL) {
+			return NULL;
+		}
+
+		if (load_queue_tail != NULL) {
+			load_queue_tail->next_queued = entry;
+		} else {
+			load_queue_head = entry;
+		}
+		load_queue_tail = entry;
+		cond_broadcast(&cache_wake);
+	}
+	return entry;
+}
+
+bool tz_region_load_async(char *region_name, TZ_Load_Fn fn, void *user) {
+	run_once(&loader_once, start_loader);
+	if (!loader_running) {
+		return false;
+	}
+
+	Load_Waiter *waiter = NULL;
+	if (fn != NULL) {
+		waiter = malloc(sizeof(Load_Waiter));
+		if (waiter == NULL) {
+			return false;
+		}
+		*waiter = (Load_Waiter){.fn = fn, .user = user};
+	}
+
+	mutex_lock(&cache_lock);
+	Cache_Entry *entry = cache_request(region_name);
+	if (entry == NULL) {
+		mutex_unlock(&cache_lock);
+		free(waiter);
+		return false;
+	}
+
+	if (entry->state != Cache_Pending) {
+		bool ok = entry->state == Cache_Loaded;
+		mutex_unlock(&cache_lock);
+		if (waiter != NULL) {
+			fn(user, entry->name, entry->region, ok);
+			free(waiter);
+		}
+		return true;
+	}
+
+	if (waiter != NULL) {
+		waiter->next = entry->waiters;
+		entry->waiters = waiter;
+	}
+	mutex_unlock(&cache_lock);
+	return true;
+}
+
+bool tz_prefetch(char **region_names, int64_t count) {
+	run_once(&loader_once, start_loader);
+	if (!loader_running) {
+		return false;
+	}
+
+	bool queued = true;
+	mutex_lock(&cache_lock);
+	for (int64_t i = 0; i < count; i++) {
+		if (cache_request(region_names[i]) == NULL) {
+			queued = false;
+		}
+	}
+	mutex_unlock(&cache_lock);
+	return queued;
+}
+
+// Loaded entries never change again, so this doesn't need the lock
+bool tz_region_cached(char *region_name, TZ_Region **region) {
+	Cache_Entry *entry = cache_find(region_name);
+	if (entry == NULL || __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) != Cache_Loaded) {
+		return false;
+	}
+	*region = entry->region;
+	return true;
+}
+
+// SECTION: Nanosecond Time
+static int64_t seconds_to_ns_clamped(int64_t secs) {
+	if (secs <= (INT64_MIN / NS_PER_SECOND)) return INT64_MIN;
+	if (secs >= (INT64_MAX / NS_PER_SECOND)) return INT64_MAX;
+	return secs * NS_PER_SECOND;
+}
+
+TZ_Time_Ns tz_time_ns_from_unix_ns(int64_t time) {
+	return (TZ_Time_Ns){.time = time, .tz = NULL};
+}
+
+TZ_Time_Ns tz_time_ns_from_time(TZ_Time t, int32_t nanoseconds) {
+	return (TZ_Time_Ns){.time = (t.time * NS_PER_SECOND) + nanoseconds, .tz = t.tz};
+}
+
+TZ_Time tz_time_ns_to_time(TZ_Time_Ns t) {
+	return (TZ_Time){.time = floor_div(t.time, NS_PER_SECOND), .tz = t.tz};
+}
+
+TZ_Time_Ns tz_time_ns_to_utc(TZ_Time_Ns t) {
+	if (t.tz == NULL) {
+		return t;
+	}
+
+	int64_t utc_offset = region_get_offset(t.tz, floor_div(t.time, NS_PER_SECOND));
+	return (TZ_Time_Ns){.time = t.time - (utc_offset * NS_PER_SECOND), .tz = NULL};
+}
+
+int64_t tz_time_ns_to_unix_ns(TZ_Time_Ns t) {
+	TZ_Time_Ns out_t = tz_time_ns_to_utc(t);
+	return out_t.time;
+}
+
+TZ_Time_Ns tz_time_ns_to_tz(TZ_Time_Ns in_t, TZ_Region *tz) {
+	TZ_Time_Ns t = in_t;
+	if (t.tz == tz) {
+		return t;
+	}
+	if (t.tz != NULL) {
+		t = tz_time_ns_to_utc(t);
+	}
+	if (tz == NULL) {
+		return t;
+	}
+
+	int64_t utc_offset = region_get_offset(tz, floor_div(t.time, NS_PER_SECOND));
+	return (TZ_Time_Ns){.time = t.time + (utc_offset * NS_PER_SECOND), .tz = tz};
+}
+
+TZ_Date tz_get_date_ns(TZ_Time_Ns t) {
+	return tz_get_date(tz_time_ns_to_time(t));
+}
+
+TZ_HMS_Ns tz_get_hms_ns(TZ_Time_Ns t) {
+	TZ_HMS hms = tz_get_hms(tz_time_ns_to_time(t));
+	return (TZ_HMS_Ns){
+		.hours       = hms.hours,
+		.minutes     = hms.minutes,
+		.seconds     = hms.seconds,
+		.nanoseconds = (int32_t)floor_mod(t.time, NS_PER_SECOND),
+	};
+}
+
+// The offset only changes at transitions, so we keep the current span in nanoseconds
+// and only drop back to seconds (and a region search) when a timestamp leaves it
+void tz_convert_ns_batch(TZ_Region *tz, int64_t *utc_ns, int64_t *local_ns, int64_t count) {
+	if (tz == NULL) {
+		memmove(local_ns, utc_ns, count * sizeof(int64_t));
+		return;
+	}
+
+	int64_t from_ns   = 1;
+	int64_t until_ns  = 0;
+	int64_t offset_ns = 0;
+	for (int64_t i = 0; i < count; i++) {
+		int64_t t = utc_ns[i];
+		if (t < from_ns || t >= until_ns) {
+			TZ_Lookup span = region_get_span(tz, floor_div(t, NS_PER_SECOND));
+			from_ns   = seconds_to_ns_clamped(span.valid_from);
+			until_ns  = seconds_to_ns_clamped(span.valid_until);
+			offset_ns = span.utc_offset * NS_PER_SECOND;
+		}
+		local_ns[i] = t + offset_ns;
+	}
+}
+
+// SECTION: Current Time
+static Once_Flag local_region_once = ONCE_FLAG_INITIALIZER;
+static TZ_Region *local_region = NULL;
+
+// Each thread keeps the span it last saw, so reading the clock only costs
+// a compare until the next transition comes around
+typedef struct {
+	int64_t from;
+	int64_t until;
+	int64_t utc_offset;
+} Offset_Cache;
+
+static _Thread_local Offset_Cache now_cache    = {.from = 1, .until = 0};
+static _Thread_local Offset_Cache now_ns_cache = {.from = 1, .until = 0};
+
+static void load_shared_local_region(void) {
+	TZ_Region *region = NULL;
+	if (!load_local_region(true, &region)) {
+		region = NULL;
+	}
+	local_region = region;
+}
+
+TZ_Region *tz_local_region(void) {
+	run_once(&local_region_once, load_shared_local_region);
+	return local_region;
+}
+
+TZ_Time tz_now_local(void) {
+	TZ_Region *tz = tz_local_region();
+	int64_t now = (int64_t)time(NULL);
+
+	Offset_Cache *cache = &now_cache;
+	if (now < cache->from || now >= cache->until) {
+		TZ_Lookup span;
+		tz_lookup(tz, now, &span);
+		*cache = (Offset_Cache){.from = span.valid_from, .until = span.valid_until, .utc_offset = span.utc_offset};
+	}
+
+	return (TZ_Time){.time = now + cache->utc_offset, .tz = tz};
+}
+
+TZ_Time_Ns tz_now_local_ns(void) {
+	TZ_Region *tz = tz_local_region();
+	int64_t now = clock_now_ns();
+
+	Offset_Cache *cache = &now_ns_cache;
+	if (now < cache->from || now >= cache->until) {
+		TZ_Lookup span;
+		tz_lookup(tz, floor_div(now, NS_PER_SECOND), &span);
+		*cache = (Offset_Cache){
+			.from       = seconds_to_ns_clamped(span.valid_from),
+			.until      = seconds_to_ns_clamped(span.valid_until),
+			.utc_offset = span.utc_offset * NS_PER_SECOND,
+		};
+	}
+
+	return (TZ_Time_Ns){.time = now + cache->utc_offset, .tz = tz};
+}
+
+// SECTION: Formatting
+static char *weekday_names[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
+static char *month_names[] = {
+	"January", "February", "March",     "April",   "May",      "June",
+	"July",    "August",   "September", "October", "November", "December",
+};
+
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+	bool overflow;
+} Fmt_Buf;
+
+static void fmt_push(Fmt_Buf *b, char *str, size_t len) {
+	if (b->overflow || (b->len + len + 1) > b->cap) {
+		b->overflow = true;
+		return;
+	}
+
+	memcpy(b->buf + b->len, str, len);
+	b->len += len;
+}
+
+static void fmt_push_int(Fmt_Buf *b, int64_t val, int width) {
+	char digits[24];
+	int len = 0;
+
+	uint64_t v = (val < 0) ? (uint64_t)0 - (uint64_t)val : (uint64_t)val;
+	do {
+		digits[len++] = '0' + (char)(v % 10);
+		v /= 10;
+	} while (v != 0);
+	while (len < width) {
+		digits[len++] = '0';
+	}
+	if (val < 0) {
+		digits[len++] = '-';
+	}
+
+	char out[24];
+	for (int i = 0; i < len; i++) {
+		out[i] = digits[len - i - 1];
+	}
+	fmt_push(b, out, len);
+}
+
+static void fmt_push_offset(Fmt_Buf *b, int64_t utc_offset, bool colon) {
+	int64_t off = (utc_offset < 0) ? -utc_offset : utc_offset;
+	fmt_push(b, (utc_offset < 0) ? "-" : "+", 1);
+	fmt_push_int(b, off / SECONDS_PER_HOUR, 2);
+	if (colon) fmt_push(b, ":", 1);
+	fmt_push_int(b, (off % SECONDS_PER_HOUR) / SECONDS_PER_MINUTE, 2);
+}
+
+#define FMT_MAX_FRACS 4
+
+// Where the %N fields landed, so a formatted string can have its
+// sub-second digits rewritten without formatting it again
+typedef struct {
+	int count;
+	uint8_t pos[FMT_MAX_FRACS];
+	uint8_t width[FMT_MAX_FRACS];
+} Fmt_Fracs;
+
+static size_t format_time(char *fmt, char *buf, size_t buf_sz, int64_t time, int32_t nanoseconds, TZ_Region *tz, Fmt_Fracs *fracs) {
+	if (buf_sz == 0) return 0;
+
+	TZ_Breakdown bd;
+	tz_breakdown((TZ_Time){.time = time, .tz = tz}, &bd);
+	TZ_Date date = bd.date;
+	TZ_HMS hms = bd.hms;
+	int64_t year_day = bd.year_day;
+	int64_t weekday = bd.weekday;
+	int64_t utc_offset = bd.utc_offset;
+	char *shortname = bd.shortname;
+
+	Fmt_Buf b = {.buf = buf, .cap = buf_sz};
+	for (char *f = fmt; *f != '\0'; f++) {
+		if (*f != '%') {
+			fmt_push(&b, f, 1);
+			continue;
+		}
+
+		f += 1;
+		int width = 9;
+		if (*f >= '1' && *f <= '9' && f[1] == 'N') {
+			width = *f - '0';
+			f += 1;
+		}
+
+		switch (*f) {
+			case 'Y': { fmt_push_int(&b, date.year, 4);                    } break;
+			case 'y': { fmt_push_int(&b, floor_mod(date.year, 100), 2);    } break;
+			case 'm': { fmt_push_int(&b, date.month, 2);                   } break;
+			case 'd': { fmt_push_int(&b, date.day, 2);                     } break;
+			case 'j': { fmt_push_int(&b, year_day + 1, 3);                 } break;
+			case 'H': { fmt_push_int(&b, hms.hours, 2);                    } break;
+			case 'M': { fmt_push_int(&b, hms.minutes, 2);                  } break;
+			case 'S': { fmt_push_int(&b, hms.seconds, 2);                  } break;
+			case 's': { fmt_push_int(&b, time - utc_offset, 1);            } break;
+			case 'a': { fmt_push(&b, weekday_names[weekday], 3);           } break;
+			case 'b': { fmt_push(&b, month_names[date.month - 1], 3);      } break;
+			case 'A': {
+				fmt_push(&b, weekday_names[weekday], strlen(weekday_names[weekday]));
+			} break;
+			case 'B': {
+				fmt_push(&b, month_names[date.month - 1], strlen(month_names[date.month - 1]));
+			} break;
+			case 'F': {
+				fmt_push_int(&b, date.year, 4);  fmt_push(&b, "-", 1);
+				fmt_push_int(&b, date.month, 2); fmt_push(&b, "-", 1);
+				fmt_push_int(&b, date.day, 2);
+			} break;
+			case 'T': {
+				fmt_push_int(&b, hms.hours, 2);   fmt_push(&b, ":", 1);
+				fmt_push_int(&b, hms.minutes, 2); fmt_push(&b, ":", 1);
+				fmt_push_int(&b, hms.seconds, 2);
+			} break;
+			case 'N': {
+				if (fracs != NULL) {
+					if (fracs->count < FMT_MAX_FRACS) {
+						fracs->pos[fracs->count] = (uint8_t)MIN(b.len, UINT8_MAX);
+						fracs->width[fracs->count] = (uint8_t)width;
+					}
+					fracs->count += 1;
+				}
+
+				int64_t frac = nanoseconds;
+				for (int i = width; i < 9; i++) {
+					frac /= 10;
+				}
+				fmt_push_int(&b, frac, width);
+			} break;
+			case 'z': { fmt_push_offset(&b, utc_offset, false);            } break;
+			case ':': {
+				if (f[1] != 'z') { buf[0] = 0; return 0; }
+				f += 1;
+				fmt_push_offset(&b, utc_offset, true);
+			} break;
+			case 'Z': { fmt_push(&b, shortname, strlen(shortname));        } break;
+			case '%': { fmt_push(&b, "%", 1);                              } break;
+			default:  { buf[0] = 0; return 0; }
+		}
+	}
+
+	if (b.overflow) {
+		buf[0] = 0;
+		return 0;
+	}
+
+	buf[b.len] = 0;
+	return b.len;
+}
+
+size_t tz_format(TZ_Time t, char *fmt, char *buf, size_t buf_sz) {
+	return format_time(fmt, buf, buf_sz, t.time, 0, t.tz, NULL);
+}
+
+size_t tz_format_ns(TZ_Time_Ns t, char *fmt, char *buf, size_t buf_sz) {
+	int64_t secs = floor_div(t.time, NS_PER_SECOND);
+	int32_t nanoseconds = (int32_t)(t.time - (secs * NS_PER_SECOND));
+	return format_time(fmt, buf, buf_sz, secs, nanoseconds, t.tz, NULL);
+}
+
+// SECTION: Stamp Cache
+#define STAMP_WORDS (TZ_STAMP_MAX_LEN / 8)
+
+// One formatted stamp and the UTC seconds it holds for. The layout word
+// packs the length in the low byte, the %N count in the next, and then
+// 12 bits (position, width) per %N
+typedef struct {
+	int64_t valid_from;
+	int64_t valid_until;
+	uint64_t layout;
+	uint64_t words[STAMP_WORDS];
+} Stamp;
+
+// A seqlock around one Stamp: seq is odd while a writer is mid-update,
+// readers retry on their own copy instead of waiting, and a thread that
+// loses the race to publish just formats into its own buffer
+struct TZ_Stamp_Cache {
+	TZ_Region *tz;
+	char *fmt;
+	int64_t step;
+	uint32_t seq;
+	Stamp stamp;
+};
+
+static bool stamp_build(TZ_Stamp_Cache *cache, int64_t utc, Stamp *stamp) {
+	TZ_Lookup span;
+	tz_lookup(cache->tz, utc, &span);
+	int64_t local = utc + span.utc_offset;
+	int64_t unit_start = (floor_div(local, cache->step) * cache->step) - span.utc_offset;
+
+	stamp->valid_from = MAX(span.valid_from, unit_start);
+	stamp->valid_until = MIN(span.valid_until, unit_start + cache->step);
+
+	// Formatting takes the name and offset at the local time, so the stamp
+	// also has to stay inside the span that one comes from
+	if (cache->tz != NULL) {
+		TZ_Lookup named;
+		tz_lookup(cache->tz, local, &named);
+		if (named.valid_from != INT64_MIN) {
+			stamp->valid_from = MAX(stamp->valid_from, named.valid_from - span.utc_offset);
+		}
+		if (named.valid_until != INT64_MAX) {
+			stamp->valid_until = MIN(stamp->valid_until, named.valid_until - span.utc_offset);
+		}
+	}
+
+	memset(stamp->words, 0, sizeof(stamp->words));
+	Fmt_Fracs fracs = {0};
+	size_t len = format_time(cache->fmt, (char *)stamp->words, TZ_STAMP_MAX_LEN, local, 0, cache->tz, &fracs);
+	if ((len == 0 && cache->fmt[0] != '\0') || fracs.count > FMT_MAX_FRACS) {
+		return false;
+	}
+
+	stamp->layout = (uint64_t)len | ((uint64_t)fracs.count << 8);
+	for (int i = 0; i < fracs.count; i++) {
+		uint64_t field = (uint64_t)fracs.pos[i] | ((uint64_t)fracs.width[i] << 8);
+		stamp->layout |= field << (16 + (12 * i));
+	}
+	return true;
+}
+
+static size_t stamp_copy(Stamp *stamp, int32_t nanoseconds, char *buf, size_t buf_sz) {
+	size_t len = stamp->layout & 0xFF;
+	if (len + 1 > buf_sz) {
+		if (buf_sz > 0) buf[0] = 0;
+		return 0;
+	}
+	memcpy(buf, stamp->words, len + 1);
+
+	int frac_count = (int)((stamp->layout >> 8) & 0xFF);
+	for (int i = 0; i < frac_count; i++) {
+		uint64_t field = stamp->layout >> (16 + (12 * i));
+		int pos = (int)(field & 0xFF);
+		int width = (int)((field >> 8) & 0xF);
+
+		int32_t frac = nanoseconds;
+		for (int j = width; j < 9; j++) {
+			frac /= 10;
+		}
+		for (int j = width - 1; j >= 0; j--) {
+			buf[pos + j] = '0' + (char)(frac % 10);
+			frac /= 10;
+		}
+	}
+	return len;
+}
+
+bool tz_stamp_cache_create(TZ_Region *tz, char *fmt, TZ_Stamp_Cache **cache) {
+	TZ_Stamp_Cache *c = (TZ_Stamp_Cache *)calloc(1, sizeof(TZ_Stamp_Cache));
+	if (c == NULL) {
+		return false;
+	}
+
+	c->tz = tz;
+	c->fmt = clonestr(fmt);
+	c->stamp = (Stamp){.valid_from = 1, .valid_until = 0};
+	if (c->fmt == NULL) {
+		free(c);
+		return false;
+	}
+
+	// Stamps without seconds in them only change once a minute
+	c->step = SECONDS_PER_MINUTE;
+	for (char *f = fmt; *f != '\0'; f++) {
+		if (*f == '%' && f[1] != '\0') {
+			f += 1;
+			if (*f == 'S' || *f == 'T' || *f == 's') {
+				c->step = 1;
+			}
+		}
+	}
+
+	// Catches bad and overlong formats up front
+	Stamp probe;
+	if (!stamp_build(c, 0, &probe)) {
+		free(c->fmt);
+		free(c);
+		return false;
+	}
+
+	*cache = c;
+	return true;
+}
+
+void tz_stamp_cache_destroy(TZ_Stamp_Cache *cache) {
+	if (cache == NULL) return;
+
+	free(cache->fmt);
+	free(cache);
+}
+
+size_t tz_stamp_format(TZ_Stamp_Cache *cache, int64_t utc_ns, char *buf, size_t buf_sz) {
+	int64_t utc = floor_div(utc_ns, NS_PER_SECOND);
+	int32_t nanoseconds = (int32_t)(utc_ns - (utc * NS_PER_SECOND));
+
+	Stamp *shared = &cache->stamp;
+	uint32_t seq = __atomic_load_n(&cache->seq, __ATOMIC_ACQUIRE);
+	if ((seq & 1) == 0) {
+		Stamp stamp;
+		stamp.valid_from = __atomic_load_n(&shared->valid_from, __ATOMIC_RELAXED);
+		stamp.valid_until = __atomic_load_n(&shared->valid_until, __ATOMIC_RELAXED);
+		if (utc >= stamp.valid_from && utc < stamp.valid_until) {
+			stamp.layout = __atomic_load_n(&shared->layout, __ATOMIC_RELAXED);
+			size_t word_count = MIN(((stamp.layout & 0xFF) / 8) + 1, STAMP_WORDS);
+			for (size_t i = 0; i < word_count; i++) {
+				stamp.words[i] = __atomic_load_n(&shared->words[i], __ATOMIC_RELAXED);
+			}
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&cache->seq, __ATOMIC_RELAXED) == seq) {
+				return stamp_copy(&stamp, nanoseconds, buf, buf_sz);
+			}
+		}
+	}
+
+	Stamp stamp;
+	if (!stamp_build(cache, utc, &stamp)) {
+		if (buf_sz > 0) buf[0] = 0;
+		return 0;
+	}
+
+	if ((seq & 1) == 0 && __atomic_compare_exchange_n(&cache->seq, &seq, seq + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&shared->valid_from, stamp.valid_from, __ATOMIC_RELAXED);
+		__atomic_store_n(&shared->valid_until, stamp.valid_until, __ATOMIC_RELAXED);
+		__atomic_store_n(&shared->layout, stamp.layout, __ATOMIC_RELAXED);
+		for (size_t i = 0; i < STAMP_WORDS; i++) {
+			__atomic_store_n(&shared->words[i], stamp.words[i], __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&cache->seq, seq + 2, __ATOMIC_RELEASE);
+	}
+	return stamp_copy(&stamp, nanoseconds, buf, buf_sz);
+}
+
+size_t tz_stamp_now(TZ_Stamp_Cache *cache, char *buf, size_t buf_sz) {
+	return tz_stamp_format(cache, clock_now_ns(), buf, buf_sz);
+}
+
+// SECTION: tzdata.zi Source
+// tzdata.zi is zic's own input, squeezed down; zones get compiled the way zic would,
+// so regions come out with the same records and footer as the TZif files next to it
+typedef enum {
+	Zi_Day_Of_Month,
+	Zi_Weekday_On_Or_After,
+	Zi_Weekday_On_Or_Before,
+} Zi_Day_Kind;
+
+typedef struct {
+	int64_t month; // 1 - 12
+	int64_t day;   // lastSu is stored as Su<=31 (Su<=29 for February)
+	int64_t weekday;
+	Zi_Day_Kind day_kind;
+
+	int64_t time;
+	bool time_is_std;
+	bool time_is_ut;
+} Zi_Date;
+
+#define ZI_YEAR_MIN INT32_MIN
+#define ZI_YEAR_MAX INT32_MAX
+
+typedef struct {
+	char *name;
+	int64_t seq;
+	int64_t from_year;
+	int64_t to_year;
+	Zi_Date on;
+	int64_t save;
+	bool dst;
+	char *letters;
+} Zi_Rule;
+
+typedef struct {
+	int64_t std_offset;
+	char *rule_name;
+	Zi_Rule *rules; // NULL when the line has a fixed save instead
+	int64_t rule_count;
+	int64_t save;
+	bool dst;
+	char *format;
+
+	bool has_until;
+	int64_t until_year;
+	Zi_Date until;
+} Zi_Zone_Line;
+
+typedef struct {
+	char *name;
+	char *target; // NULL for a zone, otherwise the name it links to
+	int64_t first_line;
+	int64_t line_count;
+} Zi_Name;
+
+struct TZ_Tzdata {
+	char *text; // a copy of the file, every string points into it
+	char *version;
+
+	Zi_Rule *rules;
+	int64_t rule_count;
+	Zi_Zone_Line *lines;
+	int64_t line_count;
+	Zi_Name *names;
+	int64_t name_count;
+};
+
+#define ZI_MAX_FIELDS 12
+#define ZI_ABBR_LEN 64
+
+// zic takes any unambiguous prefix of a keyword, ignoring case
+static int zi_match_word(char *word, char **words, int count) {
+	size_t len = strlen(word);
+	if (len == 0) {
+		return -1;
+	}
+
+	int found = -1;
+	for (int i = 0; i < count; i++) {
+		bool prefix = true;
+		for (size_t j = 0; j < len; j++) {
+			if (words[i][j] == 0 || ascii_lower((uint8_t)word[j]) != ascii_lower((uint8_t)words[i][j])) {
+				prefix = false;
+				break;
+			}
+		}
+		if (!prefix) {
+			continue;
+		}
+		if (words[i][len] == 0) {
+			return i;
+		}
+		if (found >= 0) {
+			return -1;
+		}
+		found = i;
+	}
+	return found;
+}
+
+static bool zi_parse_int(char *str, int64_t *val) {
+	int64_t len = 0;
+	if (!is_numeric((uint8_t)str[0]) && !(str[0] == '-' && is_numeric((uint8_t)str[1]))) {
+		return false;
+	}
+	return parse_i64(str, val, &len) && str[len] == 0;
+}
+
+// [-]h[:mm[:ss[.frac]]], fractions round to the nearest second, ties to even
+static bool zi_parse_hms(char *str, int64_t *out) {
+	int64_t sign = 1;
+	if (*str == '-') {
+		sign = -1;
+		str += 1;
+	}
+
+	int64_t parts[3] = {0};
+	int part = 0;
+	for (;;) {
+		if (!is_numeric((uint8_t)*str)) {
+			return false;
+		}
+		int64_t val = 0;
+		while (is_numeric((uint8_t)*str)) {
+			val = (val * 10) + (*str - '0');
+			if (val > 1000000) {
+				return false;
+			}
+			str += 1;
+		}
+		parts[part++] = val;
+
+		if (*str == ':' && part < 3) {
+			str += 1;
+			continue;
+		}
+		break;
+	}
+	if (part > 1 && parts[1] >= 60) {
+		return false;
+	}
+	if (part > 2 && parts[2] > 60) {
+		return false;
+	}
+
+	if (*str == '.' && part == 3) {
+		str += 1;
+		if (!is_numeric((uint8_t)*str)) {
+			return false;
+		}
+		int tenths = *str - '0';
+		bool rest = false;
+		for (str += 1; is_numeric((uint8_t)*str); str++) {
+			rest |= (*str != '0');
+		}
+		if (tenths > 5 || (tenths == 5 && (rest || (parts[2] & 1)))) {
+			parts[2] += 1;
+		}
+	}
+	if (*str != 0) {
+		return false;
+	}
+
+	*out = sign * ((parts[0] * SECONDS_PER_HOUR) + (parts[1] * SECONDS_PER_MINUTE) + parts[2]);
+	return true;
+}
+
+// Times of day take a suffix: w is wall clock (the default), s is standard time, u / g / z are UT
+static bool zi_parse_time(char *str, Zi_Date *date) {
+	size_t len = strlen(str);
+	date->time_is_std = false;
+	date->time_is_ut = false;
+	if (len > 0) {
+		switch (ascii_lower((uint8_t)str[len - 1])) {
+			case 's': { date->time_is_std = true; str[len - 1] = 0; } break;
+			case 'w': { str[len - 1] = 0; } break;
+			case 'u': case 'g': case 'z': {
+				date->time_is_std = true;
+				date->time_is_ut = true;
+				str[len - 1] = 0;
+			} break;
+		}
+	}
+	return zi_parse_hms(str, &date->time);
+}
+
+// SAVE may end in d or s to force the dst flag, otherwise any save counts as dst
+static bool zi_parse_save(char *str, int64_t *save, bool *dst) {
+	size_t len = strlen(str);
+	int forced = -1;
+	if (len > 0 && (str[len - 1] == 'd' || str[len - 1] == 's')) {
+		forced = (str[len - 1] == 'd');
+		str[len - 1] = 0;
+	}
+	if (!zi_parse_hms(str, save)) {
+		return false;
+	}
+	*dst = (forced < 0) ? (*save != 0) : (bool)forced;
+	return true;
+}
+
+static bool zi_parse_date(char *month_str, char *day_str, char *time_str, Zi_Date *date) {
+	int month = zi_match_word(month_str, month_names, 12);
+	if (month < 0) {
+		return false;
+	}
+	date->month = month + 1;
+
+	int64_t max_day = last_day_of_month(2000, date->month);
+	char *cmp = NULL;
+	if (ascii_lower((uint8_t)day_str[0]) == 'l' && ascii_lower((uint8_t)day_str[1]) == 'a' &&
+	    ascii_lower((uint8_t)day_str[2]) == 's' && ascii_lower((uint8_t)day_str[3]) == 't') {
+		int weekday = zi_match_word(day_str + 4, weekday_names, 7);
+		if (weekday < 0) {
+			return false;
+		}
+		date->day_kind = Zi_Weekday_On_Or_Before;
+		date->weekday = weekday;
+		date->day = max_day;
+	} else if ((cmp = strstr(day_str, ">=")) != NULL || (cmp = strstr(day_str, "<=")) != NULL) {
+		date->day_kind = (cmp[0] == '>') ? Zi_Weekday_On_Or_After : Zi_Weekday_On_Or_Before;
+		char kind = cmp[0];
+		cmp[0] = 0;
+		int weekday = zi_match_word(day_str, weekday_names, 7);
+		cmp[0] = kind;
+		if (weekday < 0 || !zi_parse_int(cmp + 2, &date->day)) {
+			return false;
+		}
+		date->weekday = weekday;
+	} else {
+		date->day_kind = Zi_Day_Of_Month;
+		if (!zi_parse_int(day_str, &date->day)) {
+			return false;
+		}
+	}
+	if (date->day < 1 || date->day > max_day) {
+		return false;
+	}
+
+	return zi_parse_time(time_str, date);
+}
+
+static bool zi_parse_year(char *str, int64_t *year) {
+	static char *limits[] = {"minimum", "maximum"};
+	int limit = zi_match_word(str, limits, 2);
+	if (limit >= 0) {
+		*year = (limit == 0) ? ZI_YEAR_MIN : ZI_YEAR_MAX;
+		return true;
+	}
+	return zi_parse_int(str, year) && *year > ZI_YEAR_MIN && *year < ZI_YEAR_MAX;
+}
+
+// R NAME FROM TO - IN ON AT SAVE LETTER
+static bool zi_parse_rule(char **fields, int count, Zi_Rule *rule) {
+	if (count != 10) {
+		return false;
+	}
+
+	*rule = (Zi_Rule){.name = fields[1]};
+	if (!zi_parse_year(fields[2], &rule->from_year)) {
+		return false;
+	}
+	static char *only[] = {"only"};
+	if (zi_match_word(fields[3], only, 1) == 0) {
+		rule->to_year = rule->from_year;
+	} else if (!zi_parse_year(fields[3], &rule->to_year)) {
+		return false;
+	}
+	if (rule->from_year == ZI_YEAR_MAX || rule->to_year == ZI_YEAR_MIN || rule->from_year > rule->to_year) {
+		return false;
+	}
+
+	if (!zi_parse_date(fields[5], fields[6], fields[7], &rule->on)) {
+		return false;
+	}
+	if (!zi_parse_save(fields[8], &rule->save, &rule->dst)) {
+		return false;
+	}
+	rule->letters = (strcmp(fields[9], "-") == 0) ? (char *)"" : fields[9];
+	return true;
+}
+
+// STDOFF RULES FORMAT [UNTIL], the UNTIL fields default to Jan 1 00:00
+static bool zi_parse_zone_line(char **fields, int count, Zi_Zone_Line *line) {
+	if (count < 3 || count > 7) {
+		return false;
+	}
+
+	*line = (Zi_Zone_Line){.rule_name = fields[1], .format = fields[2]};
+	if (!zi_parse_hms(fields[0], &line->std_offset)) {
+		return false;
+	}
+
+	char *pct = strchr(line->format, '%');
+	if (pct != NULL && ((pct[1] != 's' && pct[1] != 'z') || strchr(pct + 1, '%') != NULL || strchr(line->format, '/') != NULL)) {
+		return false;
+	}
+
+	line->has_until = (count > 3);
+	if (line->has_until) {
+		if (!zi_parse_int(fields[3], &line->until_year)) {
+			return false;
+		}
+		if (!zi_parse_date((count > 4) ? fields[4] : (char *)"Jan", (count > 5) ? fields[5] : (char *)"1",
+		                   (count > 6) ? fields[6] : (char *)"0", &line->until)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int zi_rule_cmp(const void *a, const void *b) {
+	Zi_Rule *ra = (Zi_Rule *)a;
+	Zi_Rule *rb = (Zi_Rule *)b;
+	int ret = strcmp(ra->name, rb->name);
+	if (ret != 0) {
+		return ret;
+	}
+	return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+static int zi_name_cmp(const void *a, const void *b) {
+	return ascii_casecmp(((Zi_Name *)a)->name, ((Zi_Name *)b)->name);
+}
+
+static Zi_Name *zi_find_name(TZ_Tzdata *db, char *name) {
+	int64_t lo = 0;
+	int64_t hi = db->name_count;
+	while (lo < hi) {
+		int64_t mid = lo + ((hi - lo) / 2);
+		int ret = ascii_casecmp(db->names[mid].name, name);
+		if (ret == 0) {
+			return &db->names[mid];
+		}
+		if (ret < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+// Rule sets are found after the whole file is read, zones can name sets defined further down
+static bool zi_link_rules(TZ_Tzdata *db) {
+	for (int64_t i = 0; i < db->line_count; i++) {
+		Zi_Zone_Line *line = &db->lines[i];
+		if (strcmp(line->rule_name, "-") == 0) {
+			continue;
+		}
+
+		int64_t lo = 0;
+		int64_t hi = db->rule_count;
+		while (lo < hi) {
+			int64_t mid = lo + ((hi - lo) / 2);
+			if (strcmp(db->rules[mid].name, line->rule_name) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		int64_t end = lo;
+		while (end < db->rule_count && strcmp(db->rules[end].name, line->rule_name) == 0) {
+			end += 1;
+		}
+
+		if (end > lo) {
+			line->rules = &db->rules[lo];
+			line->rule_count = end - lo;
+		} else if (!zi_parse_save(line->rule_name, &line->save, &line->dst)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void tz_tzdata_destroy(TZ_Tzdata *db) {
+	if (db == NULL) return;
+
+	free(db->rules);
+	free(db->lines);
+	free(db->names);
+	free(db->text);
+	free(db);
+}
+
+bool tz_tzdata_load_from_buffer(uint8_t *buffer, size_t sz, TZ_Tzdata **out_db) {
+	TZ_Tzdata *db = (TZ_Tzdata *)calloc(1, sizeof(TZ_Tzdata));
+	if (db == NULL) {
+		return false;
+	}
+	db->text = clonestr_sz((char *)buffer, sz);
+
+	int64_t rule_cap = 0;
+	int64_t line_cap = 0;
+	int64_t name_cap = 0;
+	Zi_Name *zone = NULL;
+	bool in_zone = false;
+
+	char *end = db->text + sz;
+	char *cur = db->text;
+	while (cur < end) {
+		char *nl = memchr(cur, '\n', end - cur);
+		char *line_end = (nl == NULL) ? end : nl;
+		*line_end = 0;
+		char *line_str = cur;
+		cur = line_end + 1;
+
+		if (strncmp(line_str, "# version ", 10) == 0) {
+			db->version = line_str + 10;
+			continue;
+		}
+		char *comment = strchr(line_str, '#');
+		if (comment != NULL) {
+			*comment = 0;
+		}
+
+		char *fields[ZI_MAX_FIELDS];
+		int count = 0;
+		for (char *p = line_str; *p != 0;) {
+			while (*p == ' ' || *p == '\t' || *p == '\r') {
+				*p++ = 0;
+			}
+			if (*p == 0) {
+				break;
+			}
+			if (count == ZI_MAX_FIELDS) {
+				goto fail;
+			}
+			fields[count++] = p;
+			while (*p != 0 && *p != ' ' && *p != '\t' && *p != '\r') {
+				p++;
+			}
+		}
+		if (count == 0) {
+			continue;
+		}
+
+		// Lines after a zone line with an UNTIL carry on that zone, without a keyword
+		char **line_fields = fields;
+		int line_field_count = count;
+		if (!in_zone) {
+			static char *keywords[] = {"rule", "zone", "link"};
+			int keyword = zi_match_word(fields[0], keywords, 3);
+			if (keyword == 0) {
+				if (db->rule_count + 1 > rule_cap) {
+					rule_cap = MAX(256, rule_cap * 2);
+					db->rules = (Zi_Rule *)realloc(db->rules, rule_cap * sizeof(Zi_Rule));
+				}
+				Zi_Rule *rule = &db->rules[db->rule_count];
+				if (!zi_parse_rule(fields, count, rule)) {
+					goto fail;
+				}
+				rule->seq = db->rule_count++;
+				continue;
+			}
+			if (keyword < 0 || count < 3) {
+				goto fail;
+			}
+
+			if (db->name_count + 1 > name_cap) {
+				name_cap = MAX(64, name_cap * 2);
+				db->names = (Zi_Name *)realloc(db->names, name_cap * sizeof(Zi_Name));
+			}
+			if (keyword == 2) {
+				if (count != 3) {
+					goto fail;
+				}
+				db->names[db->name_count++] = (Zi_Name){.name = fields[2], .target = fields[1]};
+				continue;
+			}
+
+			zone = &db->names[db->name_count++];
+			*zone = (Zi_Name){.name = fields[1], .first_line = db->line_count};
+			line_fields = fields + 2;
+			line_field_count = count - 2;
+		}
+
+		if (db->line_count + 1 > line_cap) {
+			line_cap = MAX(256, line_cap * 2);
+			db->lines = (Zi_Zone_Line *)realloc(db->lines, line_cap * sizeof(Zi_Zone_Line));
+		}
+		Zi_Zone_Line *line = &db->lines[db->line_count];
+		if (!zi_parse_zone_line(line_fields, line_field_count, line)) {
+			goto fail;
+		}
+		db->line_count += 1;
+		zone->line_count += 1;
+		in_zone = line->has_until;
+	}
+	if (in_zone) {
+		goto fail;
+	}
+
+	qsort(db->rules, db->rule_count, sizeof(Zi_Rule), zi_rule_cmp);
+	if (!zi_link_rules(db)) {
+		goto fail;
+	}
+
+	qsort(db->names, db->name_count, sizeof(Zi_Name), zi_name_cmp);
+	for (int64_t i = 1; i < db->name_count; i++) {
+		if (ascii_casecmp(db->names[i - 1].name, db->names[i].name) == 0) {
+			goto fail;
+		}
+	}
+
+	*out_db = db;
+	return true;
+
+fail:
+	tz_tzdata_destroy(db);
+	return false;
+}
+
+bool tz_tzdata_load(char *path, TZ_Tzdata **db) {
+	uint8_t *buffer = NULL;
+	size_t len = 0;
+	if (!load_entire_file((path != NULL) ? path : (char *)"/usr/share/zoneinfo/tzdata.zi", &buffer, &len)) {
+		return false;
+	}
+
+	bool ret = tz_tzdata_load_from_buffer(buffer, len, db);
+	free(buffer);
+	return ret;
+}
+
+int64_t tz_tzdata_count(TZ_Tzdata *db) {
+	return db->name_count;
+}
+
+char *tz_tzdata_name(TZ_Tzdata *db, int64_t idx) {
+	if (idx < 0 || idx >= db->name_count) {
+		return NULL;
+	}
+	return db->names[idx].name;
+}
+
+char *tz_tzdata_version(TZ_Tzdata *db) {
+	return db->version;
+}
+
+// zic's rpytime, the local midnight-relative time a date lands on in a year
+static int64_t zi_date_time(Zi_Date *date, int64_t year) {
+	int64_t day = date->day;
+	if (date->month == 2 && day == 29 && !is_leap_year(year)) {
+		day = 28;
+	}
+
+	int64_t days = days_from_civil(year, date->month, 1) + day - 1;
+	if (date->day_kind != Zi_Day_Of_Month) {
+		// 1970-01-01 was a Thursday
+		int64_t weekday = floor_mod(days + 4, 7);
+		if (date->day_kind == Zi_Weekday_On_Or_After) {
+			days += floor_mod(date->weekday - weekday, 7);
+		} else {
+			days -= floor_mod(weekday - date->weekday, 7);
+		}
+	}
+	return (days * SECONDS_PER_DAY) + date->time;
+}
+
+static char zi_no_letters[] = "";
+
+// zic's doabbr; a FORMAT is STD/DST, or has %s for the rule's letters or %z for the numeric offset.
+// quote wraps anything that isn't purely alphabetic in <> for POSIX TZ strings
+static size_t zi_abbr(char *out, Zi_Zone_Line *line, char *letters, bool dst, int64_t save, bool quote) {
+	char buf[ZI_ABBR_LEN];
+	Fmt_Buf b = {.buf = buf, .cap = sizeof(buf)};
+	char *slash = strchr(line->format, '/');
+	char *pct = strchr(line->format, '%');
+
+	if (slash != NULL) {
+		if (dst) {
+			fmt_push(&b, slash + 1, strlen(slash + 1));
+		} else {
+			fmt_push(&b, line->format, slash - line->format);
+		}
+	} else if (pct == NULL) {
+		fmt_push(&b, line->format, strlen(line->format));
+	} else {
+		if (pct[1] != 'z' && letters == zi_no_letters) {
+			out[0] = 0;
+			return 0;
+		}
+
+		fmt_push(&b, line->format, pct - line->format);
+		if (pct[1] == 'z') {
+			int64_t offset = line->std_offset + save;
+			int64_t abs = (offset < 0) ? -offset : offset;
+			fmt_push(&b, (offset < 0) ? "-" : "+", 1);
+			fmt_push_int(&b, abs / SECONDS_PER_HOUR, 2);
+			if (abs % SECONDS_PER_HOUR != 0) {
+				fmt_push_int(&b, (abs / SECONDS_PER_MINUTE) % 60, 2);
+				if (abs % SECONDS_PER_MINUTE != 0) {
+					fmt_push_int(&b, abs % SECONDS_PER_MINUTE, 2);
+				}
+			}
+		} else if (letters == NULL) {
+			fmt_push(&b, "%s", 2);
+		} else {
+			fmt_push(&b, letters, strlen(letters));
+		}
+		fmt_push(&b, pct + 2, strlen(pct + 2));
+	}
+	size_t len = b.len;
+	buf[len] = 0;
+
+	bool alpha = (len > 0);
+	for (size_t i = 0; i < len; i++) {
+		alpha &= is_alphabetic((uint8_t)buf[i]);
+	}
+	if (!quote || alpha) {
+		memcpy(out, buf, len + 1);
+		return len;
+	}
+
+	out[0] = '<';
+	memcpy(out + 1, buf, len);
+	out[len + 1] = '>';
+	out[len + 2] = 0;
+	return len + 2;
+}
+
+// zic's stringoffset, [-]h[:mm[:ss]]
+static bool zi_push_offset(Fmt_Buf *b, int64_t offset) {
+	if (offset < 0) {
+		fmt_push(b, "-", 1);
+		offset = -offset;
+	}
+	int64_t hours = offset / SECONDS_PER_HOUR;
+	int64_t minutes = (offset / SECONDS_PER_MINUTE) % 60;
+	int64_t seconds = offset % 60;
+	if (hours >= 24 * 7) {
+		return false;
+	}
+
+	fmt_push_int(b, hours, 1);
+	if (minutes != 0 || seconds != 0) {
+		fmt_push(b, ":", 1);
+		fmt_push_int(b, minutes, 2);
+		if (seconds != 0) {
+			fmt_push(b, ":", 1);
+			fmt_push_int(b, seconds, 2);
+		}
+	}
+	return true;
+}
+
+// zic's stringrule, one transition date of a POSIX TZ string
+static bool zi_push_rule(Fmt_Buf *b, Zi_Rule *rule, int64_t save, int64_t std_offset) {
+	int64_t time = rule->on.time;
+	if (rule->on.day_kind == Zi_Day_Of_Month) {
+		if (rule->on.month == 2 && rule->on.day == 29) {
+			return false;
+		}
+		int64_t year_day = days_from_civil(1970, rule->on.month, rule->on.day) + 1;
+		// January and February are shorter without the J
+		if (rule->on.month <= 2) {
+			fmt_push_int(b, year_day - 1, 1);
+		} else {
+			fmt_push(b, "J", 1);
+			fmt_push_int(b, year_day, 1);
+		}
+	} else {
+		int64_t weekday = rule->on.weekday;
+		int64_t week = 0;
+		if (rule->on.day_kind == Zi_Weekday_On_Or_After) {
+			int64_t shift = (rule->on.day - 1) % 7;
+			weekday -= shift;
+			time += shift * SECONDS_PER_DAY;
+			week = 1 + ((rule->on.day - 1) / 7);
+		} else if (rule->on.day == last_day_of_month(2000, rule->on.month)) {
+			week = 5;
+		} else {
+			int64_t shift = rule->on.day % 7;
+			weekday -= shift;
+			time += shift * SECONDS_PER_DAY;
+			week = rule->on.day / 7;
+		}
+		if (weekday < 0) {
+			weekday += 7;
+		}
+		fmt_push(b, "M", 1);
+		fmt_push_int(b, rule->on.month, 1);
+		fmt_push(b, ".", 1);
+		fmt_push_int(b, week, 1);
+		fmt_push(b, ".", 1);
+		fmt_push_int(b, weekday, 1);
+	}
+
+	if (rule->on.time_is_ut) {
+		time += std_offset;
+	}
+	if (rule->on.time_is_std && !rule->dst) {
+		time += save;
+	}
+	if (time != 2 * SECONDS_PER_HOUR) {
+		fmt_push(b, "/", 1);
+		if (!zi_push_offset(b, time)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The latest rule wins, rules running to max tie, otherwise the later date in the year
+static int zi_rule_later(Zi_Rule *a, Zi_Rule *b) {
+	if (a == NULL) {
+		return (b == NULL) ? 0 : -1;
+	}
+	if (b == NULL) {
+		return 1;
+	}
+	if (a->to_year != b->to_year) {
+		return (a->to_year < b->to_year) ? -1 : 1;
+	}
+	if (a->to_year == ZI_YEAR_MAX) {
+		return 0;
+	}
+	if (a->on.month != b->on.month) {
+		return (int)(a->on.month - b->on.month);
+	}
+	return (int)(a->on.day - b->on.day);
+}
+
+// zic's stringzone, the POSIX TZ string that carries the last zone line on forever
+static bool zi_footer(Zi_Zone_Line *line, char *out, size_t out_sz) {
+	Zi_Rule *last[2] = {NULL, NULL};
+	for (int64_t i = 0; i < line->rule_count; i++) {
+		Zi_Rule *rule = &line->rules[i];
+		int cmp = zi_rule_later(last[rule->dst], rule);
+		if (cmp < 0) {
+			last[rule->dst] = rule;
+		} else if (cmp == 0) {
+			return false;
+		}
+	}
+	Zi_Rule *std_rule = last[0];
+	Zi_Rule *dst_rule = last[1];
+	int dst_cmp = (line->rules != NULL) ? zi_rule_later(dst_rule, std_rule) : (line->dst ? 1 : -1);
+
+	Zi_Zone_Line *std_line = line;
+	Zi_Zone_Line *dst_line = line;
+	Zi_Zone_Line fake_lines[2];
+	Zi_Rule std_fake, dst_fake;
+	if (dst_cmp < 0) {
+		dst_rule = NULL;
+	} else if (dst_cmp > 0) {
+		// DST all year, written as negative DST that starts on Jan 1 and ends after Dec 31
+		int64_t save = (dst_rule != NULL) ? dst_rule->save : line->save;
+		if (save >= 0) {
+			fake_lines[0] = (Zi_Zone_Line){.std_offset = line->std_offset + (2 * save), .format = (char *)"XXX"};
+			fake_lines[1] = (Zi_Zone_Line){.std_offset = fake_lines[0].std_offset, .format = line->format};
+			std_line = &fake_lines[0];
+			dst_line = &fake_lines[1];
+		}
+		dst_fake = (Zi_Rule){
+			.on      = {.month = 1, .day = 1, .day_kind = Zi_Day_Of_Month},
+			.dst     = true,
+			.save    = (save < 0) ? save : -save,
+			.letters = (dst_rule != NULL) ? dst_rule->letters : NULL,
+		};
+		std_fake = (Zi_Rule){
+			.on      = {.month = 12, .day = 31, .day_kind = Zi_Day_Of_Month, .time = SECONDS_PER_DAY + dst_fake.save},
+			.letters = (save < 0 && std_rule != NULL) ? std_rule->letters : NULL,
+		};
+		dst_rule = &dst_fake;
+		std_rule = &std_fake;
+	}
+
+	char abbr[ZI_ABBR_LEN + 2];
+	Fmt_Buf b = {.buf = out, .cap = out_sz};
+	size_t len = zi_abbr(abbr, std_line, (std_rule != NULL) ? std_rule->letters : NULL, false, 0, true);
+	fmt_push(&b, abbr, len);
+	if (!zi_push_offset(&b, -std_line->std_offset)) {
+		return false;
+	}
+
+	if (dst_rule != NULL) {
+		len = zi_abbr(abbr, dst_line, dst_rule->letters, dst_rule->dst, dst_rule->save, true);
+		fmt_push(&b, abbr, len);
+		if (dst_rule->save != SECONDS_PER_HOUR && !zi_push_offset(&b, -(dst_line->std_offset + dst_rule->save))) {
+			return false;
+		}
+		fmt_push(&b, ",", 1);
+		if (!zi_push_rule(&b, dst_rule, dst_rule->save, std_line->std_offset)) {
+			return false;
+		}
+		fmt_push(&b, ",", 1);
+		if (!zi_push_rule(&b, std_rule, dst_rule->save, std_line->std_offset)) {
+			return false;
+		}
+	}
+
+	if (b.overflow) {
+		return false;
+	}
+	out[b.len] = 0;
+	return true;
+}
+
+typedef struct {
+	int64_t utc_offset;
+	bool dst;
+	char abbr[ZI_ABBR_LEN];
+} Zi_Type;
+
+typedef struct {
+	int64_t time;
+	int32_t type;
+	bool keep;
+} Zi_Transition;
+
+typedef struct {
+	Zi_Type *types;
+	int64_t type_count;
+	int64_t type_cap;
+	Zi_Transition *trans;
+	int64_t trans_count;
+	int64_t trans_cap;
+	int64_t last_max; // the latest transition made by a rule that runs to max
+} Zi_Out;
+
+static int32_t zi_add_type(Zi_Out *out, int64_t utc_offset, bool dst, char *abbr) {
+	for (int64_t i = 0; i < out->type_count; i++) {
+		Zi_Type *t = &out->types[i];
+		if (t->utc_offset == utc_offset && t->dst == dst && strcmp(t->abbr, abbr) == 0) {
+			return (int32_t)i;
+		}
+	}
+
+	if (out->type_count + 1 > out->type_cap) {
+		out->type_cap = MAX(16, out->type_cap * 2);
+		out->types = (Zi_Type *)realloc(out->types, out->type_cap * sizeof(Zi_Type));
+	}
+	Zi_Type *t = &out->types[out->type_count];
+	*t = (Zi_Type){.utc_offset = utc_offset, .dst = dst};
+	copystr_sz(t->abbr, sizeof(t->abbr), abbr);
+	return (int32_t)out->type_count++;
+}
+
+static void zi_add_transition(Zi_Out *out, int64_t time, int32_t type) {
+	if (out->trans_count + 1 > out->trans_cap) {
+		out->trans_cap = MAX(64, out->trans_cap * 2);
+		out->trans = (Zi_Transition *)realloc(out->trans, out->trans_cap * sizeof(Zi_Transition));
+	}
+	out->trans[out->trans_count++] = (Zi_Transition){.time = time, .type = type};
+}
+
+static int zi_transition_cmp(const void *a, const void *b) {
+	int64_t ta = ((Zi_Transition *)a)->time;
+	int64_t tb = ((Zi_Transition *)b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+// zic's outzone, every zone line in turn, each starting where the previous one's UNTIL left off
+static bool zi_compile_lines(Zi_Zone_Line *lines, int64_t line_count, bool extend, Zi_Out *out) {
+	int64_t min_year = 1970;
+	int64_t max_year = 1970;
+	int64_t max_rules = 0;
+	for (int64_t i = 0; i < line_count; i++) {
+		Zi_Zone_Line *line = &lines[i];
+		if (i < line_count - 1) {
+			min_year = MIN(min_year, line->until_year);
+			max_year = MAX(max_year, line->until_year);
+		}
+		for (int64_t j = 0; j < line->rule_count; j++) {
+			Zi_Rule *rule = &line->rules[j];
+			if (rule->from_year != ZI_YEAR_MIN) {
+				min_year = MIN(min_year, rule->from_year);
+				max_year = MAX(max_year, rule->from_year);
+			}
+			if (rule->to_year != ZI_YEAR_MAX) {
+				min_year = MIN(min_year, rule->to_year);
+				max_year = MAX(max_year, rule->to_year);
+			}
+		}
+		max_rules = MAX(max_rules, line->rule_count);
+	}
+
+	// Without a footer, spell out 400 years either side, one full cycle of the Gregorian calendar
+	if (extend) {
+		min_year -= 401;
+		max_year += 401;
+	}
+
+	// Like zic -b fat, which is what distros ship: the table runs from 1900 until 32-bit time
+	// runs out, so lookups before 2038 never need the footer
+	int64_t last_rule_year = max_year;
+	min_year = MIN(min_year, 1900);
+	max_year = MAX(max_year, 2038);
+
+	// Rules go live in their FROM year and drop out after their TO year, so each year
+	// only looks at the handful of rules that can fire in it
+	int64_t *order = (int64_t *)malloc(MAX(1, max_rules) * sizeof(int64_t));
+	int64_t *live = (int64_t *)malloc(MAX(1, max_rules) * sizeof(int64_t));
+	int64_t *rule_times = (int64_t *)malloc(MAX(1, max_rules) * sizeof(int64_t));
+	bool *todo = (bool *)malloc(MAX(1, max_rules) * sizeof(bool));
+	if (order == NULL || live == NULL || rule_times == NULL || todo == NULL) {
+		free(order);
+		free(live);
+		free(rule_times);
+		free(todo);
+		return false;
+	}
+
+	bool ok = true;
+	int64_t start_time = 0;
+	int64_t save = 0;
+	out->last_max = -1;
+	for (int64_t i = 0; i < line_count && ok; i++) {
+		Zi_Zone_Line *line = &lines[i];
+		bool use_start = (i > 0);
+		bool use_until = (i < line_count - 1);
+		int64_t std_offset = line->std_offset;
+		int64_t until_time = use_until ? zi_date_time(&line->until, line->until_year) : 0;
+
+		char start_abbr[ZI_ABBR_LEN] = {0};
+		char abbr[ZI_ABBR_LEN];
+		int64_t start_offset = std_offset;
+		save = 0;
+
+		if (line->rules == NULL) {
+			save = line->save;
+			zi_abbr(start_abbr, line, NULL, line->dst, save, false);
+			int32_t type = zi_add_type(out, std_offset + save, line->dst, start_abbr);
+			if (use_start) {
+				zi_add_transition(out, start_time, type);
+				use_start = false;
+			}
+		} else {
+			// Rule sets are mostly in order already
+			for (int64_t j = 0; j < line->rule_count; j++) {
+				int64_t k = j;
+				for (; k > 0 && line->rules[order[k - 1]].from_year > line->rules[j].from_year; k--) {
+					order[k] = order[k - 1];
+				}
+				order[k] = j;
+			}
+
+			int64_t next_rule = 0;
+			int64_t live_count = 0;
+			for (int64_t year = min_year; year <= max_year; year++) {
+				if (use_until && year > line->until_year) {
+					break;
+				}
+
+				while (next_rule < line->rule_count && line->rules[order[next_rule]].from_year <= year) {
+					live[live_count++] = order[next_rule++];
+				}
+				int64_t kept = 0;
+				for (int64_t j = 0; j < live_count; j++) {
+					Zi_Rule *rule = &line->rules[live[j]];
+					if (rule->to_year < year) {
+						continue;
+					}
+					live[kept] = live[j];
+					rule_times[kept] = zi_date_time(&rule->on, year);
+					todo[kept] = (rule_times[kept] < ((int64_t)1 << 31) || year <= last_rule_year);
+					kept += 1;
+				}
+				live_count = kept;
+				if (live_count == 0 && next_rule == line->rule_count) {
+					break;
+				}
+
+				for (;;) {
+					int64_t until_utc = until_time;
+					if (use_until) {
+						if (!line->until.time_is_ut) {
+							until_utc -= std_offset;
+						}
+						if (!line->until.time_is_std) {
+							until_utc -= save;
+						}
+					}
+
+					// The next rule to fire this year, its time read with the save in effect before it
+					int64_t k = -1;
+					int64_t k_time = 0;
+					for (int64_t j = 0; j < live_count; j++) {
+						if (!todo[j]) {
+							continue;
+						}
+						Zi_Rule *rule = &line->rules[live[j]];
+						int64_t offset = rule->on.time_is_ut ? 0 : std_offset;
+						if (!rule->on.time_is_std) {
+							offset += save;
+						}
+						int64_t j_time = rule_times[j] - offset;
+						if (k < 0 || j_time < k_time) {
+							k = j;
+							k_time = j_time;
+						}
+					}
+					if (k < 0) {
+						break;
+					}
+
+					Zi_Rule *rule = &line->rules[live[k]];
+					todo[k] = false;
+					if (use_until && k_time >= until_utc) {
+						if (start_abbr[0] == 0 && std_offset + rule->save == start_offset) {
+							zi_abbr(start_abbr, line, rule->letters, rule->dst, rule->save, false);
+						}
+						break;
+					}
+
+					save = rule->save;
+					if (use_start && k_time == start_time) {
+						use_start = false;
+					}
+					if (use_start) {
+						if (k_time < start_time) {
+							start_offset = std_offset + save;
+							zi_abbr(start_abbr, line, rule->letters, rule->dst, rule->save, false);
+							continue;
+						}
+						if (start_abbr[0] == 0 && start_offset == std_offset + save) {
+							zi_abbr(start_abbr, line, rule->letters, rule->dst, rule->save, false);
+						}
+					}
+
+					zi_abbr(abbr, line, rule->letters, rule->dst, rule->save, false);
+					int32_t type = zi_add_type(out, std_offset + rule->save, rule->dst, abbr);
+					if (rule->to_year == ZI_YEAR_MAX && !(out->last_max >= 0 && k_time < out->trans[out->last_max].time)) {
+						out->last_max = out->trans_count;
+					}
+					zi_add_transition(out, k_time, type);
+				}
+			}
+		}
+
+		if (use_start) {
+			bool dst = (start_offset != std_offset);
+			if (start_abbr[0] == 0) {
+				zi_abbr(start_abbr, line, zi_no_letters, dst, save, false);
+			}
+			if (start_abbr[0] == 0) {
+				ok = false;
+				break;
+			}
+			zi_add_transition(out, start_time, zi_add_type(out, start_offset, dst, start_abbr));
+		}
+
+		if (use_until) {
+			start_time = until_time;
+			if (!line->until.time_is_std) {
+				start_time -= save;
+			}
+			if (!line->until.time_is_ut) {
+				start_time -= std_offset;
+			}
+		}
+	}
+
+	free(order);
+	free(live);
+	free(rule_times);
+	free(todo);
+	return ok;
+}
+
+// zic's writezone clean up: transitions that change nothing go, and so do ones
+// that land before the previous transition has taken effect in local time
+static void zi_optimize(Zi_Out *out) {
+	if (out->last_max >= 0) {
+		out->trans[out->last_max].keep = true;
+	}
+	if (out->trans_count > 1) {
+		qsort(out->trans, out->trans_count, sizeof(Zi_Transition), zi_transition_cmp);
+	}
+
+	Zi_Transition *trans = out->trans;
+	Zi_Type *types = out->types;
+	int64_t to = 0;
+	for (int64_t from = 0; from < out->trans_count; from++) {
+		if (to != 0) {
+			int64_t prev_offset = types[(to == 1) ? 0 : trans[to - 2].type].utc_offset;
+			if (trans[from].time + types[trans[to - 1].type].utc_offset <= trans[to - 1].time + prev_offset) {
+				trans[to - 1].type = trans[from].type;
+				continue;
+			}
+		}
+
+		Zi_Type *a = (to != 0) ? &types[trans[to - 1].type] : NULL;
+		Zi_Type *b = &types[trans[from].type];
+		if (a == NULL || trans[from].keep || a->utc_offset != b->utc_offset || a->dst != b->dst || strcmp(a->abbr, b->abbr) != 0) {
+			trans[to++] = trans[from];
+		}
+	}
+	out->trans_count = to;
+}
+
+static bool zi_build_region(Zi_Out *out, TZ_RRule *rrule, char *name, TZ_Region **region) {
+	// Only the types that are still used need a shortname
+	int32_t *name_idx = (int32_t *)malloc(MAX(1, out->type_count) * sizeof(int32_t));
+	char **shortnames = (char **)malloc(MAX(1, out->type_count) * sizeof(char *));
+	TZ_Record *records = (out->trans_count > 0) ? (TZ_Record *)malloc(out->trans_count * sizeof(TZ_Record)) : NULL;
+	if (name_idx == NULL || shortnames == NULL || (out->trans_count > 0 && records == NULL)) {
+		free(name_idx);
+		free(shortnames);
+		free(records);
+		return false;
+	}
+
+	int64_t shortname_count = 0;
+	for (int64_t i = 0; i < out->type_count; i++) {
+		name_idx[i] = -1;
+	}
+	for (int64_t i = 0; i < out->trans_count; i++) {
+		Zi_Type *type = &out->types[out->trans[i].type];
+		int32_t *idx = &name_idx[out->trans[i].type];
+		if (*idx < 0) {
+			for (int64_t j = 0; j < shortname_count; j++) {
+				if (strcmp(shortnames[j], type->abbr) == 0) {
+					*idx = (int32_t)j;
+					break;
+				}
+			}
+		}
+		if (*idx < 0) {
+			*idx = (int32_t)shortname_count;
+			shortnames[shortname_count++] = clonestr(type->abbr);
+		}
+
+		records[i] = (TZ_Record){
+			.time       = out->trans[i].time,
+			.utc_offset = type->utc_offset,
+			.shortname  = shortnames[*idx],
+			.dst        = type->dst,
+		};
+	}
+	free(name_idx);
+
+	TZ_Region *out_region = (TZ_Region *)malloc(sizeof(TZ_Region));
+	*out_region = (TZ_Region){
+		.kind            = region_kind(out->trans_count, rrule),
+		.name            = clonestr(name),
+		.records         = records,
+		.record_count    = out->trans_count,
+		.shortnames      = shortnames,
+		.shortname_count = shortname_count,
+		.rrule           = *rrule,
+	};
+	*region = out_region;
+	return true;
+}
+
+bool tz_tzdata_region(TZ_Tzdata *db, char *name, TZ_Region **region) {
+	Zi_Name *zone = zi_find_name(db, name);
+	for (int depth = 0; zone != NULL && zone->target != NULL && depth < MAX_ALIAS_DEPTH; depth++) {
+		zone = zi_find_name(db, zone->target);
+	}
+	if (zone == NULL || zone->target != NULL || zone->line_count == 0) {
+		return false;
+	}
+
+	Zi_Zone_Line *lines = &db->lines[zone->first_line];
+	Zi_Zone_Line *last_line = &lines[zone->line_count - 1];
+
+	char footer[128];
+	TZ_RRule rrule = {};
+	bool has_footer = zi_footer(last_line, footer, sizeof(footer)) &&
+	                  tz_parse_posix_tz(footer, (int)strlen(footer), &rrule);
+
+	Zi_Out out = {0};
+	bool ret = false;
+	if (!zi_compile_lines(lines, zone->line_count, !has_footer, &out)) {
+		goto done;
+	}
+	zi_optimize(&out);
+
+	// Like a TZif file with an empty footer, the last type just carries on
+	if (!has_footer) {
+		Zi_Type *last = &out.types[(out.trans_count > 0) ? out.trans[out.trans_count - 1].type : 0];
+		rrule = (TZ_RRule){
+			.has_dst    = false,
+			.std_offset = last->utc_offset,
+		};
+		copystr_sz(rrule.std_name, sizeof(rrule.std_name), last->abbr);
+	}
+
+	// UTC is a special case, we don't need to alloc
+	if (out.trans_count == 0 && !rrule.has_dst && rrule.std_offset == 0) {
+		*region = NULL;
+		ret = true;
+		goto done;
+	}
+
+	ret = zi_build_region(&out, &rrule, name, region);
+
+done:
+	free(out.types);
+	free(out.trans);
+	return ret;
+}
+
+// SECTION: Packed Time
+#define PACKED_SECONDS_BITS 52
+#define PACKED_SECONDS_MASK ((1ull << PACKED_SECONDS_BITS) - 1)
+#define PACKED_SECONDS_MIN  (-(1ll << (PACKED_SECONDS_BITS - 1)))
+#define PACKED_SECONDS_MAX  ((1ll << (PACKED_SECONDS_BITS - 1)) - 1)
+#define REGISTRY_REVERSE_LEN (TZ_PACKED_MAX_ZONES * 2)
+
+// Id 0 is always UTC. Slots are only written under registry_lock, and read
+// with atomic loads so packing and unpacking never take the lock
+static Mutex registry_lock = MUTEX_INITIALIZER;
+static TZ_Region *registry[TZ_PACKED_MAX_ZONES];
+static uint16_t registry_next = 1;
+
+typedef struct {
+	TZ_Region *tz;
+	uint16_t zone_id;
+} Registry_Entry;
+
+// Region pointer -> id, open addressed so tz_pack_time doesn't scan the registry
+static Registry_Entry registry_reverse[REGISTRY_REVERSE_LEN];
+
+static uint64_t hash_pointer(void *ptr) {
+	uint64_t x = (uint64_t)(uintptr_t)ptr;
+	x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdull;
+	return x ^ (x >> 33);
+}
+
+// Entries whose id has since been handed to another region are stale and get
+// reused, so the table never holds more than the registry's live regions
+static bool registry_remember(TZ_Region *tz, uint16_t zone_id) {
+	Registry_Entry *reuse = NULL;
+	uint64_t i = hash_pointer(tz) % REGISTRY_REVERSE_LEN;
+	for (int64_t probes = 0; probes < REGISTRY_REVERSE_LEN; probes++, i = (i + 1) % REGISTRY_REVERSE_LEN) {
+		Registry_Entry *e = &registry_reverse[i];
+		TZ_Region *cur = __atomic_load_n(&e->tz, __ATOMIC_ACQUIRE);
+		if (cur == tz) {
+			__atomic_store_n(&e->zone_id, zone_id, __ATOMIC_RELEASE);
+			return true;
+		}
+		if (cur == NULL) {
+			reuse = (reuse != NULL) ? reuse : e;
+			break;
+		}
+		if (reuse == NULL && __atomic_load_n(&registry[e->zone_id], __ATOMIC_ACQUIRE) != cur) {
+			reuse = e;
+		}
+	}
+	if (reuse == NULL) {
+		return false;
+	}
+
+	// Readers check registry[zone_id] against tz, so one seeing the old pointer with the new id just misses
+	__atomic_store_n(&reuse->zone_id, zone_id, __ATOMIC_RELEASE);
+	__atomic_store_n(&reuse->tz, tz, __ATOMIC_RELEASE);
+	return true;
+}
+
+static bool registry_find(TZ_Region *tz, uint16_t *zone_id) {
+	if (tz == NULL) {
+		*zone_id = 0;
+		return true;
+	}
+
+	uint64_t i = hash_pointer(tz) % REGISTRY_REVERSE_LEN;
+	for (int64_t probes = 0; probes < REGISTRY_REVERSE_LEN; probes++, i = (i + 1) % REGISTRY_REVERSE_LEN) {
+		Registry_Entry *e = &registry_reverse[i];
+		TZ_Region *cur = __atomic_load_n(&e->tz, __ATOMIC_ACQUIRE);
+		if (cur == NULL) {
+			return false;
+		}
+		if (cur == tz) {
+			uint16_t id = __atomic_load_n(&e->zone_id, __ATOMIC_ACQUIRE);
+
+			// The id may have been handed to another region since
+			if (__atomic_load_n(&registry[id], __ATOMIC_ACQUIRE) != tz) {
+				return false;
+			}
+			*zone_id = id;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool tz_registry_set(uint16_t zone_id, TZ_Region *tz) {
+	if (zone_id == 0 || zone_id >= TZ_PACKED_MAX_ZONES || tz == NULL) {
+		return false;
+	}
+
+	mutex_lock(&registry_lock);
+	bool success = registry_remember(tz, zone_id);
+	if (success) {
+		__atomic_store_n(&registry[zone_id], tz, __ATOMIC_RELEASE);
+	}
+	mutex_unlock(&registry_lock);
+	return success;
+}
+
+bool tz_registry_add(TZ_Region *tz, uint16_t *zone_id) {
+	if (registry_find(tz, zone_id)) {
+		return true;
+	}
+
+	bool success = false;
+	mutex_lock(&registry_lock);
+	if (registry_find(tz, zone_id)) {
+		success = true;
+		goto unlock;
+	}
+
+	for (; registry_next < TZ_PACKED_MAX_ZONES; registry_next++) {
+		if (__atomic_load_n(&registry[registry_next], __ATOMIC_ACQUIRE) == NULL) {
+			break;
+		}
+	}
+	if (registry_next == TZ_PACKED_MAX_ZONES) {
+		goto unlock;
+	}
+
+	if (!registry_remember(tz, registry_next)) {
+		goto unlock;
+	}
+	*zone_id = registry_next;
+	__atomic_store_n(&registry[registry_next], tz, __ATOMIC_RELEASE);
+	registry_next += 1;
+	success = true;
+
+unlock:
+	mutex_unlock(&registry_lock);
+	return success;
+}
+
+TZ_Region *tz_registry_get(uint16_t zone_id) {
+	if (zone_id >= TZ_PACKED_MAX_ZONES) {
+		return NULL;
+	}
+	return __atomic_load_n(&registry[zone_id], __ATOMIC_ACQUIRE);
+}
+
+bool tz_pack(int64_t utc, uint16_t zone_id, TZ_Packed *out) {
+	if (utc < PACKED_SECONDS_MIN || utc > PACKED_SECONDS_MAX || zone_id >= TZ_PACKED_MAX_ZONES) {
+		return false;
+	}
+
+	out->bits = ((uint64_t)zone_id << PACKED_SECONDS_BITS) | ((uint64_t)utc & PACKED_SECONDS_MASK);
+	return true;
+}
+
+bool tz_pack_time(TZ_Time t, TZ_Packed *out) {
+	uint16_t zone_id;
+	if (!registry_find(t.tz, &zone_id)) {
+		return false;
+	}
+	return tz_pack(tz_time_to_unix_seconds(t), zone_id, out);
+}
+
+int64_t tz_packed_unix_seconds(TZ_Packed p) {
+	return (int64_t)(p.bits << (64 - PACKED_SECONDS_BITS)) >> (64 - PACKED_SECONDS_BITS);
+}
+
+uint16_t tz_packed_zone_id(TZ_Packed p) {
+	return (uint16_t)(p.bits >> PACKED_SECONDS_BITS);
+}
+
+TZ_Packed tz_packed_to_zone(TZ_Packed p, uint16_t zone_id) {
+	return (TZ_Packed){.bits = (p.bits & PACKED_SECONDS_MASK) | ((uint64_t)(zone_id & (TZ_PACKED_MAX_ZONES - 1)) << PACKED_SECONDS_BITS)};
+}
+
+TZ_Time tz_packed_to_time(TZ_Packed p) {
+	TZ_Region *tz = tz_registry_get(tz_packed_zone_id(p));
+	int64_t utc = tz_packed_unix_seconds(p);
+	if (tz == NULL) {
+		return (TZ_Time){.time = utc, .tz = NULL};
+	}
+	return (TZ_Time){.time = utc + region_get_offset(tz, utc), .tz = tz};
+}
+
+TZ_Date tz_packed_get_date(TZ_Packed p) {
+	return tz_get_date(tz_packed_to_time(p));
+}
+
+TZ_HMS tz_packed_get_hms(TZ_Packed p) {
+	return tz_get_hms(tz_packed_to_time(p));
+}
+
+size_t tz_packed_format(TZ_Packed p, char *fmt, char *buf, size_t buf_sz) {
+	TZ_Time t = tz_packed_to_time(p);
+	return format_time(fmt, buf, buf_sz, t.time, 0, t.tz, NULL);
+}
+
+bool tz_pack_batch(int64_t *utc, uint16_t zone_id, TZ_Packed *out, int64_t count) {
+	bool all_packed = true;
+	for (int64_t i = 0; i < count; i++) {
+		if (!tz_pack(utc[i], zone_id, &out[i])) {
+			out[i] = (TZ_Packed){0};
+			all_packed = false;
+		}
+	}
+	return all_packed;
+}
+
+void tz_packed_local_batch(TZ_Packed *in, int64_t *local, int64_t count) {
+	uint16_t zone_id = 0;
+	TZ_Region *tz = NULL;
+	TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+	for (int64_t i = 0; i < count; i++) {
+		uint16_t id = tz_packed_zone_id(in[i]);
+		int64_t t = tz_packed_unix_seconds(in[i]);
+		if (id != zone_id) {
+			zone_id = id;
+			tz = tz_registry_get(id);
+			span = (TZ_Lookup){.valid_from = 1, .valid_until = 0};
+		}
+		if (t < span.valid_from || t >= span.valid_until) {
+			tz_lookup(tz, t, &span);
+		}
+		local[i] = t + span.utc_offset;
+	}
+}
+
+// SECTION: Mixed-Zone Conversion
+#define MIXED_BLOCK_LEN 65536
+
+// Zones are grouped a block at a time through a small open-addressed table
+// that maps each region to its group; slots are only cleared once used
+typedef struct {
+	TZ_Region *zone;
+	int32_t group;
+} Mixed_Slot;
+
+typedef struct {
+	Mixed_Slot *slots;
+	uint32_t slot_mask;
+	uint32_t *used;
+	int32_t *group_of;
+	int32_t *group_start;
+	TZ_Region **group_zone;
+	int32_t *order;
+} Mixed_Scratch;
+
+static uint32_t mixed_slot_hash(TZ_Region *zone, uint32_t mask) {
+	uint64_t h = (uint64_t)(uintptr_t)zone * 0x9E3779B97F4A7C15ull;
+	return (uint32_t)(h >> 32) & mask;
+}
+
+static bool mixed_scratch_create(int64_t block_len, Mixed_Scratch *scratch) {
+	uint32_t slot_count = 16;
+	while (slot_count < block_len * 2) {
+		slot_count *= 2;
+	}
+
+	*scratch = (Mixed_Scratch){.slot_mask = slot_count - 1};
+	scratch->slots = (Mixed_Slot *)malloc(slot_count * sizeof(Mixed_Slot));
+	scratch->used = (uint32_t *)malloc(block_len * sizeof(uint32_t));
+	scratch->group_of = (int32_t *)malloc(block_len * sizeof(int32_t));
+	scratch->group_start = (int32_t *)malloc((block_len + 1) * sizeof(int32_t));
+	scratch->group_zone = (TZ_Region **)malloc(block_len * sizeof(TZ_Region *));
+	scratch->order = (int32_t *)malloc(block_len * sizeof(int32_t));
+	if (scratch->slots == NULL || scratch->used == NULL || scratch->group_of == NULL ||
+		scratch->group_start == NULL || scratch->group_zone == NULL || scratch->order == NULL) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < slot_count; i++) {
+		scratch->slots[i].group = -1;
+	}
+	return true;
+}
+
+static void mixed_scratch_destroy(Mixed_Scratch *scratch) {
+	free(scratch->slots);
+	free(scratch->used);
+	free(scratch->group_of);
+	free(scratch->group_start);
+	free(scratch->group_zone);
+	free(scratch->order);
+}
+
+static void convert_mixed_block(Mixed_Scratch *scratch, TZ_Region **zones, int64_t *utc, int64_t *local, int32_t len) {
+	int32_t group_count = 0;
+	for (int32_t i = 0; i < len; i++) {
+		TZ_Region *zone = zones[i];
+		uint32_t h = mixed_slot_hash(zone, scratch->slot_mask);
+		while (scratch->slots[h].group >= 0 && scratch->slots[h].zone != zone) {
+			h = (h + 1) & scratch->slot_mask;
+		}
+
+		Mixed_Slot *slot = &scratch->slots[h];
+		if (slot->group < 0) {
+			slot->zone = zone;
+			slot->group = group_count;
+			scratch->used[group_count] = h;
+			scratch->group_zone[group_count] = zone;
+			scratch->group_start[group_count] = 0;
+			group_count += 1;
+		}
+		scratch->group_of[i] = slot->group;
+		scratch->group_start[slot->group] += 1;
+	}
+
+	// Counts to starting positions, then a stable scatter of row indices so
+	// each group keeps its rows in input order
+	int32_t total = 0;
+	for (int32_t g = 0; g < group_count; g++) {
+		int32_t n = scratch->group_start[g];
+		scratch->group_start[g] = total;
+		total += n;
+	}
+	scratch->group_start[group_count] = total;
+
+	for (int32_t i = 0; i < len; i++) {
+		int32_t g = scratch->group_of[i];
+		scratch->order[scratch->group_start[g]] = i;
+		scratch->group_start[g] += 1;
+	}
+
+	// The scatter moved every start to the next group's start
+	int32_t start = 0;
+	for (int32_t g = 0; g < group_count; g++) {
+		TZ_Region *zone = scratch->group_zone[g];
+		int32_t end = scratch->group_start[g];
+
+		TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+		for (int32_t k = start; k < end; k++) {
+			int32_t i = scratch->order[k];
+			int64_t t = utc[i];
+			if (t < span.valid_from || t >= span.valid_until) {
+				tz_lookup(zone, t, &span);
+			}
+			local[i] = t + span.utc_offset;
+		}
+
+		scratch->slots[scratch->used[g]].group = -1;
+		start = end;
+	}
+}
+
+void tz_convert_mixed(TZ_Region **zones, int64_t *utc, int64_t *local, int64_t count) {
+	Mixed_Scratch scratch;
+	if (count <= 0) {
+		return;
+	}
+
+	int64_t block_len = MIN(count, MIXED_BLOCK_LEN);
+	if (!mixed_scratch_create(block_len, &scratch)) {
+		mixed_scratch_destroy(&scratch);
+
+		// No room to group, so just keep the span while the zone repeats
+		TZ_Region *zone = NULL;
+		TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+		for (int64_t i = 0; i < count; i++) {
+			int64_t t = utc[i];
+			if (zones[i] != zone) {
+				zone = zones[i];
+				span = (TZ_Lookup){.valid_from = 1, .valid_until = 0};
+			}
+			if (t < span.valid_from || t >= span.valid_until) {
+				tz_lookup(zone, t, &span);
+			}
+			local[i] = t + span.utc_offset;
+		}
+		return;
+	}
+
+	for (int64_t base = 0; base < count; base += block_len) {
+		int32_t len = (int32_t)MIN(block_len, count - base);
+		convert_mixed_block(&scratch, zones + base, utc + base, local + base, len);
+	}
+	mixed_scratch_destroy(&scratch);
+}
+
+// SECTION: World Clock
+// Every zone's current span, with a min-heap on when each one runs out,
+// so moving the clock forward only touches the zones that have a transition
+typedef struct {
+	int64_t until;
+	int64_t zone;
+} Clock_Entry;
+
+struct TZ_World_Clock {
+	TZ_Region **zones;
+	TZ_Lookup *states;
+	int64_t zone_count;
+	int64_t now;
+
+	Clock_Entry *heap;
+	int64_t heap_len;
+
+	int64_t *changed;
+	int64_t changed_count;
+};
+
+static void clock_sift_down(Clock_Entry *heap, int64_t len, int64_t idx) {
+	Clock_Entry entry = heap[idx];
+	for (;;) {
+		int64_t child = (idx * 2) + 1;
+		if (child >= len) {
+			break;
+		}
+		if (child + 1 < len && heap[child + 1].until < heap[child].until) {
+			child += 1;
+		}
+		if (heap[child].until >= entry.until) {
+			break;
+		}
+		heap[idx] = heap[child];
+		idx = child;
+	}
+	heap[idx] = entry;
+}
+
+static bool lookup_changed(TZ_Lookup *a, TZ_Lookup *b) {
+	return a->utc_offset != b->utc_offset || a->dst != b->dst || strcmp(a->shortname, b->shortname) != 0;
+}
+
+// Looks every zone up again and rebuilds the heap, for the first snapshot and for going back in time
+static void clock_rebuild(TZ_World_Clock *clock, int64_t utc, bool track_changes) {
+	clock->heap_len = 0;
+	for (int64_t i = 0; i < clock->zone_count; i++) {
+		TZ_Lookup prev = clock->states[i];
+		tz_lookup(clock->zones[i], utc, &clock->states[i]);
+		if (track_changes && lookup_changed(&prev, &clock->states[i])) {
+			clock->changed[clock->changed_count++] = i;
+		}
+
+		// Fixed zones never come up again
+		if (clock->states[i].valid_until != INT64_MAX) {
+			clock->heap[clock->heap_len++] = (Clock_Entry){.until = clock->states[i].valid_until, .zone = i};
+		}
+	}
+
+	for (int64_t i = (clock->heap_len / 2) - 1; i >= 0; i--) {
+		clock_sift_down(clock->heap, clock->heap_len, i);
+	}
+	clock->now = utc;
+}
+
+void tz_world_clock_destroy(TZ_World_Clock *clock) {
+	if (clock == NULL) return;
+
+	free(clock->zones);
+	free(clock->states);
+	free(clock->heap);
+	free(clock->changed);
+	free(clock);
+}
+
+bool tz_world_clock_create(TZ_Region **zones, int64_t count, int64_t utc, TZ_World_Clock **out_clock) {
+	if (count < 0) {
+		return false;
+	}
+
+	TZ_World_Clock *clock = (TZ_World_Clock *)calloc(1, sizeof(TZ_World_Clock));
+	if (clock == NULL) {
+		return false;
+	}
+	clock->zone_count = count;
+	clock->zones = (TZ_Region **)malloc(MAX(1, count) * sizeof(TZ_Region *));
+	clock->states = (TZ_Lookup *)malloc(MAX(1, count) * sizeof(TZ_Lookup));
+	clock->heap = (Clock_Entry *)malloc(MAX(1, count) * sizeof(Clock_Entry));
+	clock->changed = (int64_t *)malloc(MAX(1, count) * sizeof(int64_t));
+	if (clock->zones == NULL || clock->states == NULL || clock->heap == NULL || clock->changed == NULL) {
+		tz_world_clock_destroy(clock);
+		return false;
+	}
+	memcpy(clock->zones, zones, count * sizeof(TZ_Region *));
+
+	clock_rebuild(clock, utc, false);
+	*out_clock = clock;
+	return true;
+}
+
+// Returns how many zones changed offset, dst flag or shortname, tz_world_clock_changed lists them
+int64_t tz_world_clock_advance(TZ_World_Clock *clock, int64_t utc) {
+	clock->changed_count = 0;
+	if (utc < clock->now) {
+		clock_rebuild(clock, utc, true);
+		return clock->changed_count;
+	}
+
+	// A zone's new span holds utc, so each zone comes off the heap at most once
+	while (clock->heap_len > 0 && clock->heap[0].until <= utc) {
+		int64_t zone = clock->heap[0].zone;
+		TZ_Lookup prev = clock->states[zone];
+		tz_lookup(clock->zones[zone], utc, &clock->states[zone]);
+		if (lookup_changed(&prev, &clock->states[zone])) {
+			clock->changed[clock->changed_count++] = zone;
+		}
+
+		if (clock->states[zone].valid_until == INT64_MAX) {
+			clock->heap_len -= 1;
+			clock->heap[0] = clock->heap[clock->heap_len];
+		} else {
+			clock->heap[0].until = clock->states[zone].valid_until;
+		}
+		if (clock->heap_len > 0) {
+			clock_sift_down(clock->heap, clock->heap_len, 0);
+		}
+	}
+	clock->now = utc;
+
+	return clock->changed_count;
+}
+
+int64_t *tz_world_clock_changed(TZ_World_Clock *clock) {
+	return clock->changed;
+}
+
+TZ_Lookup *tz_world_clock_states(TZ_World_Clock *clock) {
+	return clock->states;
+}
+
+int64_t tz_world_clock_next(TZ_World_Clock *clock) {
+	return (clock->heap_len > 0) ? clock->heap[0].until : INT64_MAX;
+}
+
+// SECTION: Zone Pairs
+#define ZONE_PAIR_FIRST_YEAR 1800
+#define ZONE_PAIR_LAST_YEAR 2100
+
+// Input times are wall times in the source zone, and deltas[i] holds from
+// starts[i] until starts[i + 1] (or the horizon); times outside of
+// [starts[0], horizon) fall back to tz_time_to_tz
+struct TZ_Zone_Pair {
+	TZ_Region *from;
+	TZ_Region *to;
+	int64_t *starts;
+	int64_t *deltas;
+	int64_t count;
+	int64_t horizon;
+};
+
+static bool zone_pair_push(TZ_Zone_Pair *pair, int64_t *cap, int64_t start, int64_t delta) {
+	if (pair->count > 0 && pair->deltas[pair->count - 1] == delta) {
+		return true;
+	}
+
+	if (pair->count + 1 > *cap) {
+		*cap = MAX(64, *cap * 2);
+		int64_t *starts = (int64_t *)realloc(pair->starts, *cap * sizeof(int64_t));
+		if (starts == NULL) {
+			return false;
+		}
+		pair->starts = starts;
+
+		int64_t *deltas = (int64_t *)realloc(pair->deltas, *cap * sizeof(int64_t));
+		if (deltas == NULL) {
+			return false;
+		}
+		pair->deltas = deltas;
+	}
+
+	pair->starts[pair->count] = start;
+	pair->deltas[pair->count] = delta;
+	pair->count += 1;
+	return true;
+}
+
+void tz_zone_pair_destroy(TZ_Zone_Pair *pair) {
+	if (pair == NULL) return;
+
+	free(pair->starts);
+	free(pair->deltas);
+	free(pair);
+}
+
+bool tz_zone_pair_create(TZ_Region *from, TZ_Region *to, TZ_Zone_Pair **out_pair) {
+	TZ_Zone_Pair *pair = (TZ_Zone_Pair *)calloc(1, sizeof(TZ_Zone_Pair));
+	if (pair == NULL) {
+		return false;
+	}
+	pair->from = from;
+	pair->to = to;
+	pair->horizon = year_to_time(ZONE_PAIR_LAST_YEAR + 1);
+
+	// Walk both zones' spans at once, the same way tz_time_to_tz reads them:
+	// the source offset is looked up at the input time, and the target offset
+	// at the UTC time that gives. Each piece ends wherever either one changes
+	int64_t cap = 0;
+	int64_t x = year_to_time(ZONE_PAIR_FIRST_YEAR);
+	while (x < pair->horizon) {
+		TZ_Lookup from_span, to_span;
+		tz_lookup(from, x, &from_span);
+		tz_lookup(to, x - from_span.utc_offset, &to_span);
+
+		int64_t delta = to_span.utc_offset - from_span.utc_offset;
+		if (!zone_pair_push(pair, &cap, x, delta)) {
+			tz_zone_pair_destroy(pair);
+			return false;
+		}
+
+		int64_t to_until = (to_span.valid_until == INT64_MAX) ? INT64_MAX : to_span.valid_until + from_span.utc_offset;
+		int64_t until = (from_span.valid_until < to_until) ? from_span.valid_until : to_until;
+		if (until <= x) {
+			until = x + 1;
+		}
+		x = until;
+	}
+
+	*out_pair = pair;
+	return true;
+}
+
+// Branchless, so random input doesn't pay a mispredict per step
+static int64_t zone_pair_find(TZ_Zone_Pair *pair, int64_t t) {
+	int64_t *base = pair->starts;
+	int64_t n = pair->count;
+	while (n > 1) {
+		int64_t half = n / 2;
+		base = (base[half] <= t) ? base + half : base;
+		n -= half;
+	}
+	return base - pair->starts;
+}
+
+static int64_t zone_pair_fallback(TZ_Zone_Pair *pair, int64_t t) {
+	return tz_time_to_tz((TZ_Time){.time = t, .tz = pair->from}, pair->to).time;
+}
+
+TZ_Time tz_zone_pair_convert(TZ_Zone_Pair *pair, TZ_Time t) {
+	// The table only knows wall times in the source zone
+	if (t.tz != pair->from) {
+		return tz_time_to_tz(t, pair->to);
+	}
+	if (t.time < pair->starts[0] || t.time >= pair->horizon) {
+		return (TZ_Time){.time = zone_pair_fallback(pair, t.time), .tz = pair->to};
+	}
+	return (TZ_Time){.time = t.time + pair->deltas[zone_pair_find(pair, t.time)], .tz = pair->to};
+}
+
+void tz_zone_pair_cursor_init(TZ_Zone_Pair_Cursor *cursor, TZ_Zone_Pair *pair) {
+	cursor->pair = pair;
+	cursor->idx = pair->count - 1;
+}
+
+int64_t tz_zone_pair_cursor_convert(TZ_Zone_Pair_Cursor *cursor, int64_t t) {
+	TZ_Zone_Pair *pair = cursor->pair;
+	if (t < pair->starts[0] || t >= pair->horizon) {
+		return zone_pair_fallback(pair, t);
+	}
+
+	int64_t idx = cursor->idx;
+	bool in_piece = pair->starts[idx] <= t && (idx + 1 == pair->count || t < pair->starts[idx + 1]);
+	if (!in_piece) {
+		// Sorted input only ever steps to the next piece, anything else gets a search
+		if (idx + 1 < pair->count && pair->starts[idx + 1] <= t && (idx + 2 == pair->count || t < pair->starts[idx + 2])) {
+			idx += 1;
+		} else {
+			idx = zone_pair_find(pair, t);
+		}
+		cursor->idx = idx;
+	}
+	return t + pair->deltas[idx];
+}
+
+void tz_zone_pair_convert_batch(TZ_Zone_Pair *pair, int64_t *in, int64_t *out, int64_t count) {
+	TZ_Zone_Pair_Cursor cursor;
+	tz_zone_pair_cursor_init(&cursor, pair);
+	for (int64_t i = 0; i < count; i++) {
+		out[i] = tz_zone_pair_cursor_convert(&cursor, in[i]);
+	}
+}
+
+// SECTION: Local Time Resolution
+// The spans on either side of the one local could land in; a local time
+// maps into a span when span.valid_from <= local - offset < span.valid_until
+typedef struct {
+	TZ_Lookup spans[3];
+} Local_Neighbourhood;
+
+// Neighbours with the same offset are the same span as far as local time
+// goes (the seam between a table and its footer rule leaves these), so
+// merge them to keep the real transitions within reach
+static void span_merge_back(TZ_Region *tz, TZ_Lookup *span) {
+	while (span->valid_from != INT64_MIN) {
+		TZ_Lookup prev;
+		tz_lookup(tz, span->valid_from - 1, &prev);
+		if (prev.utc_offset != span->utc_offset) {
+			break;
+		}
+		span->valid_from = prev.valid_from;
+	}
+}
+
+static void span_merge_forward(TZ_Region *tz, TZ_Lookup *span) {
+	while (span->valid_until != INT64_MAX) {
+		TZ_Lookup next;
+		tz_lookup(tz, span->valid_until, &next);
+		if (next.utc_offset != span->utc_offset) {
+			break;
+		}
+		span->valid_until = next.valid_until;
+	}
+}
+
+static Local_Neighbourhood local_neighbourhood(TZ_Region *tz, int64_t local) {
+	Local_Neighbourhood n;
+	TZ_Lookup guess;
+	tz_lookup(tz, local, &guess);
+	tz_lookup(tz, local - guess.utc_offset, &n.spans[1]);
+	span_merge_back(tz, &n.spans[1]);
+	span_merge_forward(tz, &n.spans[1]);
+
+	if (n.spans[1].valid_from == INT64_MIN) {
+		n.spans[0] = n.spans[1];
+	} else {
+		tz_lookup(tz, n.spans[1].valid_from - 1, &n.spans[0]);
+		span_merge_back(tz, &n.spans[0]);
+	}
+	if (n.spans[1].valid_until == INT64_MAX) {
+		n.spans[2] = n.spans[1];
+	} else {
+		tz_lookup(tz, n.spans[1].valid_until, &n.spans[2]);
+		span_merge_forward(tz, &n.spans[2]);
+	}
+	return n;
+}
+
+static bool span_holds_local(TZ_Lookup *span, int64_t local) {
+	int64_t utc = local - span->utc_offset;
+	return utc >= span->valid_from && utc < span->valid_until;
+}
+
+// The first and last of the spans local maps into, false when it's in a gap
+static bool neighbourhood_holding(Local_Neighbourhood *n, int64_t local, int *first, int *last) {
+	*first = -1;
+	*last = -1;
+	for (int i = 0; i < 3; i++) {
+		if ((i > 0 && n->spans[i].valid_from == n->spans[i - 1].valid_from) || !span_holds_local(&n->spans[i], local)) {
+			continue;
+		}
+		if (*first < 0) {
+			*first = i;
+		}
+		*last = i;
+	}
+	return *first >= 0;
+}
+
+// The span before the transition that local was skipped over by, or -1
+static int neighbourhood_gap(Local_Neighbourhood *n, int64_t local) {
+	for (int i = 0; i < 2; i++) {
+		int64_t boundary = n->spans[i + 1].valid_from;
+		if (local - n->spans[i].utc_offset >= boundary && local - n->spans[i + 1].utc_offset < boundary) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// unique gets the index of the span when local maps into exactly one, or -1
+static bool resolve_local(Local_Neighbourhood *n, int64_t local, TZ_Resolve_Policy policy, int64_t *utc, int *unique) {
+	int first, last;
+	*unique = -1;
+	if (neighbourhood_holding(n, local, &first, &last)) {
+		int pick = (policy.fold == TZ_Fold_Later) ? last : first;
+		*utc = local - n->spans[pick].utc_offset;
+		if (first == last) {
+			*unique = first;
+		}
+		return true;
+	}
+
+	int gap = neighbourhood_gap(n, local);
+	if (gap >= 0) {
+		switch (policy.gap) {
+			case TZ_Gap_Shift_Forward: *utc = local - n->spans[gap].utc_offset; return true;
+			case TZ_Gap_Next_Valid:    *utc = n->spans[gap + 1].valid_from;    return true;
+			case TZ_Gap_Reject:        return false;
+		}
+	}
+	return false;
+}
+
+bool tz_local_to_utc(TZ_Region *tz, int64_t local, TZ_Resolve_Policy policy, int64_t *utc) {
+	if (tz == NULL) {
+		*utc = local;
+		return true;
+	}
+
+	Local_Neighbourhood n = local_neighbourhood(tz, local);
+	int unique;
+	return resolve_local(&n, local, policy, utc, &unique);
+}
+
+// Fills spans with the ones local maps into, earlier first, and returns how
+// many; a local time in a gap maps into none, and gets the spans on either side
+int tz_local_candidates(TZ_Region *tz, int64_t local, TZ_Lookup spans[2]) {
+	if (tz == NULL) {
+		tz_lookup(NULL, local, &spans[0]);
+		return 1;
+	}
+
+	Local_Neighbourhood n = local_neighbourhood(tz, local);
+	int first, last;
+	if (neighbourhood_holding(&n, local, &first, &last)) {
+		spans[0] = n.spans[first];
+		spans[1] = n.spans[last];
+		return (first == last) ? 1 : 2;
+	}
+
+	int gap = neighbourhood_gap(&n, local);
+	spans[0] = (gap >= 0) ? n.spans[gap] : n.spans[1];
+	spans[1] = (gap >= 0) ? n.spans[gap + 1] : n.spans[1];
+	return 0;
+}
+
+// The local times only one span can produce; while they stay inside it, that
+// span's offset is all it takes to convert them
+typedef struct {
+	int64_t lo;
+	int64_t hi;
+	int64_t offset;
+} Local_Window;
+
+// Offsets differ by less than a day, so two days inside a span nothing else
+// can produce local, and the neighbours don't need looking up; the window is
+// left empty when local is closer than that to a transition
+static void local_window_seed(TZ_Region *tz, Local_Window *window, int64_t local) {
+	TZ_Lookup span;
+	tz_lookup(tz, local, &span);
+	if (local - span.utc_offset < span.valid_from || local - span.utc_offset >= span.valid_until) {
+		tz_lookup(tz, local - span.utc_offset, &span);
+	}
+
+	int64_t margin = 2 * SECONDS_PER_DAY;
+	int64_t lo = (span.valid_from == INT64_MIN) ? INT64_MIN : span.valid_from + margin + span.utc_offset;
+	int64_t hi = (span.valid_until == INT64_MAX) ? INT64_MAX : span.valid_until - margin + span.utc_offset;
+	*window = (local >= lo && local < hi) ? (Local_Window){.lo = lo, .hi = hi, .offset = span.utc_offset} : (Local_Window){.lo = 1, .hi = 0};
+}
+
+static bool local_window_resolve(TZ_Region *tz, Local_Window *window, int64_t local, TZ_Resolve_Policy policy, int64_t *utc) {
+	if (local >= window->lo && local < window->hi) {
+		*utc = local - window->offset;
+		return true;
+	}
+
+	local_window_seed(tz, window, local);
+	if (local >= window->lo && local < window->hi) {
+		*utc = local - window->offset;
+		return true;
+	}
+
+	Local_Neighbourhood n = local_neighbourhood(tz, local);
+	int unique;
+	window->lo = 1;
+	window->hi = 0;
+	if (!resolve_local(&n, local, policy, utc, &unique)) {
+		return false;
+	}
+
+	if (unique == 1) {
+		TZ_Lookup *span = &n.spans[1];
+		int64_t prev_offset = n.spans[0].utc_offset;
+		int64_t next_offset = n.spans[2].utc_offset;
+		window->lo = (span->valid_from == INT64_MIN) ? INT64_MIN : span->valid_from + MAX(span->utc_offset, prev_offset);
+		window->hi = (span->valid_until == INT64_MAX) ? INT64_MAX : span->valid_until + MIN(span->utc_offset, next_offset);
+		window->offset = span->utc_offset;
+	}
+	return true;
+}
+
+static bool components_valid(int64_t year, int64_t month, int64_t day, int64_t hour, int64_t minute, int64_t second) {
+	return month >= 1 && month <= 12 &&
+		day >= 1 && day <= last_day_of_month(year, month) &&
+		hour >= 0 && hour <= 23 &&
+		minute >= 0 && minute <= 59 &&
+		second >= 0 && second <= 60;
+}
+
+int64_t tz_components_to_utc_batch(TZ_Region *tz, TZ_Component_Columns *cols, TZ_Resolve_Policy policy, int64_t *out_utc, int64_t count) {
+	int64_t failed = 0;
+
+	// Pass one: wall-clock seconds. Feeds are mostly sorted, so the year's
+	// first day only gets recomputed when the year changes, and everything
+	// else is table lookups and multiplies
+	int64_t cached_year = INT64_MIN;
+	int64_t year_days = 0;
+	bool leap = false;
+	for (int64_t i = 0; i < count; i++) {
+		int64_t year = cols->year[i];
+		int64_t month = cols->month[i];
+		int64_t day = cols->day[i];
+		int64_t hour = cols->hour[i];
+		int64_t minute = cols->minute[i];
+		int64_t second = cols->second[i];
+
+		if (!components_valid(year, month, day, hour, minute, second)) {
+			out_utc[i] = INT64_MIN;
+			failed += 1;
+			continue;
+		}
+
+		if (year != cached_year) {
+			cached_year = year;
+			year_days = days_from_civil(year, 1, 1);
+			leap = is_leap_year(year);
+		}
+
+		int64_t days = year_days + days_before[month - 1] + ((leap && month > 2) ? 1 : 0) + day - 1;
+		out_utc[i] = (days * SECONDS_PER_DAY) + (hour * SECONDS_PER_HOUR) + (minute * SECONDS_PER_MINUTE) + second;
+	}
+
+	if (tz == NULL) {
+		return failed;
+	}
+
+	// Pass two: local -> UTC, mostly from the window of the row before
+	Local_Window window = {.lo = 1, .hi = 0};
+	for (int64_t i = 0; i < count; i++) {
+		int64_t local = out_utc[i];
+		if (local == INT64_MIN) {
+			continue;
+		}
+
+		if (!local_window_resolve(tz, &window, local, policy, &out_utc[i])) {
+			out_utc[i] = INT64_MIN;
+			failed += 1;
+		}
+	}
+
+	return failed;
+}
+
+// SECTION: Calendar Arithmetic
+// Years, months and days move the wall clock, with the day clamped to the end
+// of a shorter month, and the result gets resolved with the policy; hours,
+// minutes and seconds are then added as elapsed time, so adding a day across a
+// DST change keeps the clock time and adding 24 hours doesn't
+static int64_t local_add_calendar(int64_t local, int64_t months, int64_t days) {
+	int64_t day = floor_div(local, SECONDS_PER_DAY);
+	int64_t secs = local - (day * SECONDS_PER_DAY);
+	if (months != 0) {
+		int64_t year, month, mday;
+		civil_from_days(day, &year, &month, &mday);
+		int64_t total = (year * 12) + (month - 1) + months;
+		year = floor_div(total, 12);
+		month = floor_mod(total, 12) + 1;
+		day = days_from_civil(year, month, MIN(mday, last_day_of_month(year, month)));
+	}
+	return ((day + days) * SECONDS_PER_DAY) + secs;
+}
+
+static int64_t period_months(TZ_Period *period) {
+	return (period->years * 12) + period->months;
+}
+
+static int64_t period_seconds(TZ_Period *period) {
+	return (period->hours * SECONDS_PER_HOUR) + (period->minutes * SECONDS_PER_MINUTE) + period->seconds;
+}
+
+// Back to the wall clock, through the window when the result never left the span it started in
+static int64_t utc_to_local_in_window(TZ_Region *tz, Local_Window *window, int64_t utc) {
+	int64_t local = utc + window->offset;
+	if (local >= window->lo && local < window->hi) {
+		return local;
+	}
+
+	TZ_Lookup span;
+	tz_lookup(tz, utc, &span);
+	return utc + span.utc_offset;
+}
+
+static bool local_add(TZ_Region *tz, Local_Window *window, int64_t local, int64_t months, int64_t days, int64_t seconds, TZ_Resolve_Policy policy, int64_t *out) {
+	local = local_add_calendar(local, months, days);
+	if (tz == NULL) {
+		*out = local + seconds;
+		return true;
+	}
+
+	int64_t utc;
+	if (!local_window_resolve(tz, window, local, policy, &utc)) {
+		return false;
+	}
+	*out = utc_to_local_in_window(tz, window, utc + seconds);
+	return true;
+}
+
+bool tz_add(TZ_Time t, TZ_Period period, TZ_Resolve_Policy policy, TZ_Time *out) {
+	// Starting from t's own span, results that stay inside it need no more lookups
+	Local_Window window = {.lo = 1, .hi = 0};
+	if (t.tz != NULL) {
+		local_window_seed(t.tz, &window, t.time);
+	}
+
+	int64_t local;
+	if (!local_add(t.tz, &window, t.time, period_months(&period), period.days, period_seconds(&period), policy, &local)) {
+		return false;
+	}
+
+	*out = (TZ_Time){.time = local, .tz = t.tz};
+	return true;
+}
+
+int64_t tz_add_batch(TZ_Region *tz, int64_t *local, TZ_Period period, TZ_Resolve_Policy policy, int64_t *out_local, int64_t count) {
+	int64_t months = period_months(&period);
+	int64_t seconds = period_seconds(&period);
+	int64_t failed = 0;
+
+	Local_Window window = {.lo = 1, .hi = 0};
+	for (int64_t i = 0; i < count; i++) {
+		if (!local_add(tz, &window, local[i], months, period.days, seconds, policy, &out_local[i])) {
+			out_local[i] = INT64_MIN;
+			failed += 1;
+		}
+	}
+	return failed;
+}
+
+// Every step is taken from start, so a schedule starting on the 31st comes back to the 31st after a short month
+int64_t tz_add_series(TZ_Time start, TZ_Period step, TZ_Resolve_Policy policy, int64_t *out_local, int64_t count) {
+	int64_t months = period_months(&step);
+	int64_t seconds = period_seconds(&step);
+	int64_t failed = 0;
+
+	Local_Window window = {.lo = 1, .hi = 0};
+	for (int64_t i = 0; i < count; i++) {
+		if (!local_add(start.tz, &window, start.time, months * i, step.days * i, seconds * i, policy, &out_local[i])) {
+			out_local[i] = INT64_MIN;
+			failed += 1;
+		}
+	}
+	return failed;
+}
+
+// The largest whole months, then days, that don't pass to on the wall clock,
+// and whatever elapsed time is left; tz_add(from, period) gets back to to
+static bool local_diff_calendar(TZ_Region *tz, Local_Window *window, int64_t from_local, int64_t from_utc, int64_t to_local, int64_t to_utc, TZ_Resolve_Policy policy, TZ_Period *out) {
+	int64_t sign = (to_utc >= from_utc) ? 1 : -1;
+
+	int64_t from_year, from_month, from_day;
+	int64_t to_year, to_month, to_day;
+	civil_from_days(floor_div(from_local, SECONDS_PER_DAY), &from_year, &from_month, &from_day);
+	civil_from_days(floor_div(to_local, SECONDS_PER_DAY), &to_year, &to_month, &to_day);
+
+	int64_t months = ((to_year - from_year) * 12) + (to_month - from_month);
+	int64_t mid = local_add_calendar(from_local, months, 0);
+	if ((sign > 0 && months > 0 && mid > to_local) || (sign < 0 && months < 0 && mid < to_local)) {
+		months -= sign;
+		mid = local_add_calendar(from_local, months, 0);
+	}
+
+	// Truncating division leaves the rest of the day with the same sign
+	int64_t days = (to_local - mid) / SECONDS_PER_DAY;
+	mid += days * SECONDS_PER_DAY;
+
+	int64_t mid_utc = mid;
+	if (tz != NULL && !local_window_resolve(tz, window, mid, policy, &mid_utc)) {
+		return false;
+	}
+	int64_t rest = to_utc - mid_utc;
+
+	*out = (TZ_Period){
+		.years   = months / 12,
+		.months  = months % 12,
+		.days    = days,
+		.hours   = rest / SECONDS_PER_HOUR,
+		.minutes = (rest % SECONDS_PER_HOUR) / SECONDS_PER_MINUTE,
+		.seconds = rest % SECONDS_PER_MINUTE,
+	};
+	return true;
+}
+
+bool tz_diff_calendar(TZ_Time from, TZ_Time to, TZ_Resolve_Policy policy, TZ_Period *out) {
+	int64_t from_utc, to_utc;
+	if (!tz_local_to_utc(from.tz, from.time, policy, &from_utc) || !tz_local_to_utc(to.tz, to.time, policy, &to_utc)) {
+		return false;
+	}
+
+	// Both ends are counted on from's calendar
+	int64_t to_local = to_utc;
+	if (from.tz != NULL) {
+		TZ_Lookup span;
+		tz_lookup(from.tz, to_utc, &span);
+		to_local += span.utc_offset;
+	}
+
+	Local_Window window = {.lo = 1, .hi = 0};
+	return local_diff_calendar(from.tz, &window, from.time, from_utc, to_local, to_utc, policy, out);
+}
+
+int64_t tz_diff_calendar_batch(TZ_Region *tz, int64_t *from_local, int64_t *to_local, TZ_Resolve_Policy policy, TZ_Period *out, int64_t count) {
+	int64_t failed = 0;
+
+	Local_Window window = {.lo = 1, .hi = 0};
+	for (int64_t i = 0; i < count; i++) {
+		int64_t from_utc = from_local[i];
+		int64_t to_utc = to_local[i];
+		int64_t to = to_local[i];
+		bool ok = true;
+		if (tz != NULL) {
+			ok = local_window_resolve(tz, &window, from_local[i], policy, &from_utc) &&
+				local_window_resolve(tz, &window, to_local[i], policy, &to_utc);
+			to = utc_to_local_in_window(tz, &window, to_utc);
+		}
+		if (!ok || !local_diff_calendar(tz, &window, from_local[i], from_utc, to, to_utc, policy, &out[i])) {
+			out[i] = (TZ_Period){INT64_MIN, INT64_MIN, INT64_MIN, INT64_MIN, INT64_MIN, INT64_MIN};
+			failed += 1;
+		}
+	}
+	return failed;
+}
+
+// SECTION: Calendar Buckets
+// Bucket keys count whole units from the one holding 1970-01-01: local days,
+// ISO weeks (Monday 1969-12-29 is week 0) or months
+#define MAX_BUCKET_TABLE_LEN (1 << 20)
+
+static int64_t bucket_key_from_day(TZ_Bucket_Unit unit, int64_t day) {
+	switch (unit) {
+		case TZ_Bucket_Day: return day;
+		case TZ_Bucket_ISO_Week: return floor_div(day + 3, 7);
+		case TZ_Bucket_Month: {
+			int64_t year, month, mday;
+			civil_from_days(day, &year, &month, &mday);
+			return ((year - 1970) * 12) + (month - 1);
+		}
+	}
+	return day;
+}
+
+// Within a key of the real one, which is all the boundary table needs; months
+// average out to 146097 days per 4800
+static int64_t bucket_key_guess(TZ_Bucket_Unit unit, int64_t day) {
+	if (unit == TZ_Bucket_Month) {
+		return floor_div(day * 4800, 146097);
+	}
+	return bucket_key_from_day(unit, day);
+}
+
+static int64_t bucket_first_day(TZ_Bucket_Unit unit, int64_t key) {
+	switch (unit) {
+		case TZ_Bucket_Day: return key;
+		case TZ_Bucket_ISO_Week: return (key * 7) - 3;
+		case TZ_Bucket_Month: return days_from_civil(1970 + floor_div(key, 12), floor_mod(key, 12) + 1, 1);
+	}
+	return key;
+}
+
+// The first instant the local clock reaches the bucket's first midnight; if
+// midnight falls in a gap that's the end of the gap, and buckets always tile
+// the UTC timeline, so a 23h or 25h day is just a shorter or longer bucket
+static int64_t bucket_start_utc(TZ_Region *tz, TZ_Bucket_Unit unit, int64_t key) {
+	int64_t midnight = bucket_first_day(unit, key) * SECONDS_PER_DAY;
+
+	// Offsets stay within a day, so two days back is before any instant showing midnight
+	int64_t t = midnight - (2 * SECONDS_PER_DAY);
+	for (;;) {
+		TZ_Lookup span;
+		tz_lookup(tz, t, &span);
+
+		int64_t candidate = MAX(t, midnight - span.utc_offset);
+		if (candidate < span.valid_until) {
+			return candidate;
+		}
+		t = span.valid_until;
+	}
+}
+
+typedef struct {
+	int64_t key;
+	int64_t start;
+	int64_t end;
+} Bucket_Span;
+
+static Bucket_Span bucket_for_time(TZ_Region *tz, TZ_Bucket_Unit unit, int64_t utc, TZ_Lookup *span) {
+	if (utc < span->valid_from || utc >= span->valid_until) {
+		tz_lookup(tz, utc, span);
+	}
+
+	int64_t key = bucket_key_from_day(unit, floor_div(utc + span->utc_offset, SECONDS_PER_DAY));
+	Bucket_Span b = {.key = key, .start = bucket_start_utc(tz, unit, key), .end = bucket_start_utc(tz, unit, key + 1)};
+	while (utc < b.start) {
+		b.key -= 1;
+		b.end = b.start;
+		b.start = bucket_start_utc(tz, unit, b.key);
+	}
+	while (utc >= b.end) {
+		b.key += 1;
+		b.start = b.end;
+		b.end = bucket_start_utc(tz, unit, b.key + 1);
+	}
+	return b;
+}
+
+void tz_bucket_batch(TZ_Region *tz, TZ_Bucket_Unit unit, int64_t *utc, int64_t *out_keys, int64_t *out_bucket_start_utc, int64_t count) {
+	if (count <= 0) {
+		return;
+	}
+
+	int64_t min_t = utc[0];
+	int64_t max_t = utc[0];
+	for (int64_t i = 1; i < count; i++) {
+		min_t = (utc[i] < min_t) ? utc[i] : min_t;
+		max_t = (utc[i] > max_t) ? utc[i] : max_t;
+	}
+
+	// Guessing the local day with one offset and nudging the guess against a
+	// table of boundaries needs no per-row offset lookups at all
+	TZ_Lookup hint;
+	tz_lookup(tz, min_t, &hint);
+
+	int64_t first_key = bucket_key_from_day(unit, floor_div(min_t, SECONDS_PER_DAY)) - 1;
+	int64_t last_key  = bucket_key_from_day(unit, floor_div(max_t, SECONDS_PER_DAY)) + 1;
+	int64_t table_len = last_key - first_key + 2;
+
+	int64_t *starts = NULL;
+	if (last_key - first_key < MAX_BUCKET_TABLE_LEN && table_len <= count) {
+		starts = (int64_t *)malloc(table_len * sizeof(int64_t));
+	}
+
+	if (starts != NULL) {
+		for (int64_t i = 0; i < table_len; i++) {
+			starts[i] = bucket_start_utc(tz, unit, first_key + i);
+		}
+
+		for (int64_t i = 0; i < count; i++) {
+			int64_t t = utc[i];
+			int64_t idx = bucket_key_guess(unit, floor_div(t + hint.utc_offset, SECONDS_PER_DAY)) - first_key;
+			idx = (idx < 0) ? 0 : (idx > table_len - 2) ? table_len - 2 : idx;
+			while (idx > 0 && t < starts[idx]) {
+				idx -= 1;
+			}
+			while (idx < table_len - 2 && t >= starts[idx + 1]) {
+				idx += 1;
+			}
+
+			out_keys[i] = first_key + idx;
+			if (out_bucket_start_utc != NULL) {
+				out_bucket_start_utc[i] = starts[idx];
+			}
+		}
+
+		free(starts);
+		return;
+	}
+
+	TZ_Lookup span = {.valid_from = 1, .valid_until = 0};
+	Bucket_Span cur = {.start = 1, .end = 0};
+	for (int64_t i = 0; i < count; i++) {
+		int64_t t = utc[i];
+		if (t < cur.start || t >= cur.end) {
+			cur = bucket_for_time(tz, unit, t, &span);
+		}
+
+		out_keys[i] = cur.key;
+		if (out_bucket_start_utc != NULL) {
+			out_bucket_start_utc[i] = cur.start;
+		}
+	}
+}
+
+TZ_Date tz_bucket_date(TZ_Bucket_Unit unit, int64_t key) {
+	int64_t year, month, day;
+	civil_from_days(bucket_first_day(unit, key), &year, &month, &day);
+	return (TZ_Date){.year = year, .month = (int8_t)month, .day = (int8_t)day};
+}
+
+// SECTION: Leap Seconds
+// From IERS Bulletin C, TAI - UTC before 1972 wasn't a whole number of seconds, so we hold it at 10
+static TZ_Leapsecond builtin_leapseconds[] = {
+	{  63072000, 10}, // 1972-01-01
+	{  78796800, 11}, // 1972-07-01
+	{  94694400, 12}, // 1973-01-01
+	{ 126230400, 13}, // 1974-01-01
+	{ 157766400, 14}, // 1975-01-01
+	{ 189302400, 15}, // 1976-01-01
+	{ 220924800, 16}, // 1977-01-01
+	{ 252460800, 17}, // 1978-01-01
+	{ 283996800, 18}, // 1979-01-01
+	{ 315532800, 19}, // 1980-01-01
+	{ 362793600, 20}, // 1981-07-01
+	{ 394329600, 21}, // 1982-07-01
+	{ 425865600, 22}, // 1983-07-01
+	{ 489024000, 23}, // 1985-07-01
+	{ 567993600, 24}, // 1988-01-01
+	{ 631152000, 25}, // 1990-01-01
+	{ 662688000, 26}, // 1991-01-01
+	{ 709948800, 27}, // 1992-07-01
+	{ 741484800, 28}, // 1993-07-01
+	{ 773020800, 29}, // 1994-07-01
+	{ 820454400, 30}, // 1996-01-01
+	{ 867715200, 31}, // 1997-07-01
+	{ 915148800, 32}, // 1999-01-01
+	{1136073600, 33}, // 2006-01-01
+	{1230768000, 34}, // 2009-01-01
+	{1341100800, 35}, // 2012-07-01
+	{1435708800, 36}, // 2015-07-01
+	{1483228800, 37}, // 2017-01-01
+};
+
+void tz_leap_cursor_init(TZ_Leap_Cursor *cursor, TZ_Region *tz) {
+	if (tz != NULL && tz->leapsecond_count > 0) {
+		cursor->table = tz->leapseconds;
+		cursor->count = tz->leapsecond_count;
+	} else {
+		cursor->table = builtin_leapseconds;
+		cursor->count = ARR_LEN(builtin_leapseconds);
+	}
+
+	// Most timestamps we see are after the last leapsecond, start there
+	cursor->idx = cursor->count - 1;
+}
+
+static int64_t leap_tai_start(TZ_Leap_Cursor *cursor, int64_t idx) {
+	return cursor->table[idx].time + cursor->table[idx].tai_offset;
+}
+
+static int64_t leap_offset(TZ_Leap_Cursor *cursor) {
+	return (cursor->idx < 0) ? TAI_UTC_BASE : cursor->table[cursor->idx].tai_offset;
+}
+
+int64_t tz_leap_cursor_utc_to_tai(TZ_Leap_Cursor *cursor, int64_t utc) {
+	while (cursor->idx + 1 < cursor->count && cursor->table[cursor->idx + 1].time <= utc) {
+		cursor->idx += 1;
+	}
+	while (cursor->idx >= 0 && cursor->table[cursor->idx].time > utc) {
+		cursor->idx -= 1;
+	}
+
+	return utc + leap_offset(cursor);
+}
+
+int64_t tz_leap_cursor_tai_to_utc(TZ_Leap_Cursor *cursor, int64_t tai, bool *is_leap) {
+	while (cursor->idx + 1 < cursor->count && leap_tai_start(cursor, cursor->idx + 1) <= tai) {
+		cursor->idx += 1;
+	}
+	while (cursor->idx >= 0 && leap_tai_start(cursor, cursor->idx) > tai) {
+		cursor->idx -= 1;
+	}
+
+	int64_t utc = tai - leap_offset(cursor);
+
+	// An inserted second has no UTC value of its own, we pin it to 23:59:59
+	bool leap = false;
+	int64_t next = cursor->idx + 1;
+	if (next < cursor->count && utc >= cursor->table[next].time) {
+		utc = cursor->table[next].time - 1;
+		leap = true;
+	}
+
+	if (is_leap != NULL) {
+		*is_leap = leap;
+	}
+	return utc;
+}
+
+int64_t tz_utc_to_tai(TZ_Region *tz, int64_t utc) {
+	TZ_Leap_Cursor cursor;
+	tz_leap_cursor_init(&cursor, tz);
+	if (utc >= cursor.table[cursor.idx].time) {
+		return utc + cursor.table[cursor.idx].tai_offset;
+	}
+
+	int64_t left = 0;
+	int64_t right = cursor.count;
+	while (left < right) {
+		int64_t mid = (int64_t)((uint64_t)(left + right) >> 1);
+		if (cursor.table[mid].time <= utc) {
+			left = mid + 1;
+		} else {
+			right = mid;
+		}
+	}
+	cursor.idx = left - 1;
+	return tz_leap_cursor_utc_to_tai(&cursor, utc);
+}
+
+int64_t tz_tai_to_utc(TZ_Region *tz, int64_t tai, bool *is_leap) {
+	TZ_Leap_Cursor cursor;
+	tz_leap_cursor_init(&cursor, tz);
+	if (tai >= leap_tai_start(&cursor, cursor.idx)) {
+		return tz_leap_cursor_tai_to_utc(&cursor, tai, is_leap);
+	}
+
+	int64_t left = 0;
+	int64_t right = cursor.count;
+	while (left < right) {
+		int64_t mid = (int64_t)((uint64_t)(left + right) >> 1);
+		if (leap_tai_start(&cursor, mid) <= tai) {
+			left = mid + 1;
+		} else {
+			right = mid;
+		}
+	}
+	cursor.idx = left - 1;
+	return tz_leap_cursor_tai_to_utc(&cursor, tai, is_leap);
+}
+
+void tz_utc_to_tai_batch(TZ_Region *tz, int64_t *utc, int64_t *tai, int64_t count) {
+	TZ_Leap_Cursor cursor;
+	tz_leap_cursor_init(&cursor, tz);
+	for (int64_t i = 0; i < count; i++) {
+		tai[i] = tz_leap_cursor_utc_to_tai(&cursor, utc[i]);
+	}
+}
+
+void tz_tai_to_utc_batch(TZ_Region *tz, int64_t *tai, int64_t *utc, int64_t count) {
+	TZ_Leap_Cursor cursor;
+	tz_leap_cursor_init(&cursor, tz);
+	for (int64_t i = 0; i < count; i++) {
+		utc[i] = tz_leap_cursor_tai_to_utc(&cursor, tai[i], NULL);
+	}
+}
+
+// SECTION: Parallel Conversion
+#define PARALLEL_CHUNK_LEN 8192
+#define CACHE_LINE_SIZE 64
+
+// Each worker owns a range of task indices, packed as lo | (hi << 32) so the
+// owner popping from the front and thieves splitting off the back can both
+// claim work with a single CAS
+typedef struct {
+	uint64_t range;
+	uint8_t pad[CACHE_LINE_SIZE - sizeof(uint64_t)];
+} Pool_Queue;
+
+struct TZ_Pool {
+	int32_t worker_count;
+
+	TZ_Pool_Run_Fn custom_run;
+	void *custom_user;
+
+	Thread *threads;
+	Pool_Queue *queues;
+
+	Mutex run_lock;
+	Mutex lock;
+	Cond wake;
+	Cond idle;
+	uint64_t generation;
+	int32_t busy;
+	bool shutdown;
+
+	TZ_Task_Fn fn;
+	void *ctx;
+	int64_t task_base;
+};
+
+typedef struct {
+	TZ_Pool *pool;
+	int32_t worker;
+} Pool_Worker;
+
+static uint64_t pack_range(uint32_t lo, uint32_t hi) {
+	return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+static bool queue_pop(Pool_Queue *q, uint32_t *task) {
+	uint64_t cur = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		uint32_t lo = (uint32_t)cur;
+		uint32_t hi = (uint32_t)(cur >> 32);
+		if (lo >= hi) {
+			return false;
+		}
+
+		if (__atomic_compare_exchange_n(&q->range, &cur, pack_range(lo + 1, hi), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*task = lo;
+			return true;
+		}
+	}
+}
+
+// Takes the back half of the victim's range; the thief's own queue is empty
+// at this point, so nobody else can be racing on it
+static bool queue_steal(Pool_Queue *victim, Pool_Queue *thief) {
+	uint64_t cur = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		uint32_t lo = (uint32_t)cur;
+		uint32_t hi = (uint32_t)(cur >> 32);
+		if (lo >= hi) {
+			return false;
+		}
+
+		uint32_t mid = hi - ((hi - lo + 1) / 2);
+		if (__atomic_compare_exchange_n(&victim->range, &cur, pack_range(lo, mid), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&thief->range, pack_range(mid, hi), __ATOMIC_RELEASE);
+			return true;
+		}
+	}
+}
+
+static void pool_work(TZ_Pool *pool, int32_t worker) {
+	Pool_Queue *own = &pool->queues[worker];
+	for (;;) {
+		uint32_t task;
+		while (queue_pop(own, &task)) {
+			pool->fn(pool->ctx, pool->task_base + task, worker);
+		}
+
+		bool stole = false;
+		for (int32_t i = 1; i < pool->worker_count && !stole; i++) {
+			stole = queue_steal(&pool->queues[(worker + i) % pool->worker_count], own);
+		}
+		if (!stole) {
+			return;
+		}
+	}
+}
+
+static void pool_thread(void *arg) {
+	Pool_Worker *w = (Pool_Worker *)arg;
+	TZ_Pool *pool = w->pool;
+	int32_t worker = w->worker;
+	free(w);
+
+	uint64_t seen = 0;
+	for (;;) {
+		mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->shutdown) {
+			cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->shutdown) {
+			mutex_unlock(&pool->lock);
+			return;
+		}
+		seen = pool->generation;
+		mutex_unlock(&pool->lock);
+
+		pool_work(pool, worker);
+
+		mutex_lock(&pool->lock);
+		pool->busy -= 1;
+		if (pool->busy == 0) {
+			cond_broadcast(&pool->idle);
+		}
+		mutex_unlock(&pool->lock);
+	}
+}
+
+static TZ_Pool *pool_alloc(int32_t worker_count) {
+	TZ_Pool *pool = calloc(1, sizeof(TZ_Pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->worker_count = worker_count;
+	mutex_init(&pool->run_lock);
+	mutex_init(&pool->lock);
+	cond_init(&pool->wake);
+	cond_init(&pool->idle);
+	return pool;
+}
+
+bool tz_pool_create(int32_t thread_count, TZ_Pool **out_pool) {
+	if (thread_count <= 0) {
+		thread_count = cpu_count();
+	}
+
+	TZ_Pool *pool = pool_alloc(thread_count);
+	if (pool == NULL) {
+		return false;
+	}
+
+	pool->queues  = calloc(thread_count, sizeof(Pool_Queue));
+	pool->threads = calloc(thread_count, sizeof(Thread));
+	if (pool->queues == NULL || pool->threads == NULL) {
+		pool->worker_count = 0;
+		tz_pool_destroy(pool);
+		return false;
+	}
+
+	// The thread calling tz_pool_run works as worker 0, so only spawn the rest
+	for (int32_t i = 1; i < thread_count; i++) {
+		Pool_Worker *w = malloc(sizeof(Pool_Worker));
+		if (w == NULL) {
+			pool->worker_count = i;
+			tz_pool_destroy(pool);
+			return false;
+		}
+		*w = (Pool_Worker){.pool = pool, .worker = i};
+
+		if (!thread_start(&pool->threads[i], pool_thread, w)) {
+			free(w);
+			pool->worker_count = i;
+			tz_pool_destroy(pool);
+			return false;
+		}
+	}
+
+	*out_pool = pool;
+	return true;
+}
+
+bool tz_pool_create_custom(int32_t worker_count, TZ_Pool_Run_Fn run, void *user, TZ_Pool **out_pool) {
+	if (worker_count <= 0 || run == NULL) {
+		return false;
+	}
+
+	TZ_Pool *pool = pool_alloc(worker_count);
+	if (pool == NULL) {
+		return false;
+	}
+
+	pool->custom_run  = run;
+	pool->custom_user = user;
+	*out_pool = pool;
+	return true;
+}
+
+void tz_pool_destroy(TZ_Pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	if (pool->threads != NULL) {
+		mutex_lock(&pool->lock);
+		pool->shutdown = true;
+		cond_broadcast(&pool->wake);
+		mutex_unlock(&pool->lock);
+
+		for (int32_t i = 1; i < pool->worker_count; i++) {
+			thread_join(pool->threads[i]);
+		}
+	}
+
+	cond_destroy(&pool->idle);
+	cond_destroy(&pool->wake);
+	mutex_destroy(&pool->lock);
+	mutex_destroy(&pool->run_lock);
+	free(pool->threads);
+	free(pool->queues);
+	free(pool);
+}
+
+int32_t tz_pool_worker_count(TZ_Pool *pool) {
+	return (pool == NULL) ? 1 : pool->worker_count;
+}
+
+static void pool_run_round(TZ_Pool *pool, int64_t base, uint32_t task_count) {
+	int32_t n = pool->worker_count;
+	uint32_t per = task_count / n;
+	uint32_t extra = task_count % n;
+	uint32_t lo = 0;
+	for (int32_t i = 0; i < n; i++) {
+		uint32_t hi = lo + per + ((uint32_t)i < extra ? 1 : 0);
+		__atomic_store_n(&pool->queues[i].range, pack_range(lo, hi), __ATOMIC_RELAXED);
+		lo = hi;
+	}
+
+	mutex_lock(&pool->lock);
+	pool->task_base = base;
+	pool->busy = n - 1;
+	pool->generation += 1;
+	cond_broadcast(&pool->wake);
+	mutex_unlock(&pool->lock);
+
+	pool_work(pool, 0);
+
+	mutex_lock(&pool->lock);
+	while (pool->busy > 0) {
+		cond_wait(&pool->idle, &pool->lock);
+	}
+	mutex_unlock(&pool->lock);
+}
+
+void tz_pool_run(TZ_Pool *pool, TZ_Task_Fn fn, void *ctx, int64_t task_count) {
+	if (task_count <= 0) {
+		return;
+	}
+
+	if (pool == NULL || (pool->custom_run == NULL && pool->worker_count == 1)) {
+		for (int64_t i = 0; i < task_count; i++) {
+			fn(ctx, i, 0);
+		}
+		return;
+	}
+
+	if (pool->custom_run != NULL) {
+		pool->custom_run(pool->custom_user, fn, ctx, task_count);
+		return;
+	}
+
+	mutex_lock(&pool->run_lock);
+	pool->fn  = fn;
+	pool->ctx = ctx;
+	for (int64_t base = 0; base < task_count; base += UINT32_MAX) {
+		int64_t left = task_count - base;
+		pool_run_round(pool, base, (left > UINT32_MAX) ? UINT32_MAX : (uint32_t)left);
+	}
+	mutex_unlock(&pool->run_lock);
+}
+
+// Padded out so workers don't share a cache line while updating their spans
+typedef union {
+	TZ_Lookup span;
+	uint8_t pad[CACHE_LINE_SIZE];
+} Worker_Cursor;
+
+typedef struct {
+	TZ_Region *tz;
+	int64_t *utc;
+	int64_t *local;
+	int64_t count;
+	Worker_Cursor *cursors;
+} Convert_Job;
+
+static void convert_chunk(void *ctx, int64_t task, int32_t worker) {
+	Convert_Job *job = (Convert_Job *)ctx;
+	TZ_Lookup *span = &job->cursors[worker].span;
+
+	int64_t start = task * PARALLEL_CHUNK_LEN;
+	int64_t end = start + PARALLEL_CHUNK_LEN;
+	if (end > job->count) {
+		end = job->count;
+	}
+
+	for (int64_t i = start; i < end; i++) {
+		int64_t t = job->utc[i];
+		if (t < span->valid_from || t >= span->valid_until) {
+			tz_lookup(job->tz, t, span);
+		}
+		job->local[i] = t + span->utc_offset;
+	}
+}
+
+void tz_convert_parallel(TZ_Region *tz, int64_t *utc, int64_t *local, int64_t count, TZ_Pool *pool) {
+	int32_t workers = tz_pool_worker_count(pool);
+	int64_t chunks = (count + PARALLEL_CHUNK_LEN - 1) / PARALLEL_CHUNK_LEN;
+	if (workers == 1 || chunks < 2) {
+		tz_convert_batch(tz, utc, local, count);
+		return;
+	}
+
+	Worker_Cursor *cursors = malloc(workers * sizeof(Worker_Cursor));
+	if (cursors == NULL) {
+		tz_convert_batch(tz, utc, local, count);
+		return;
+	}
+	for (int32_t i = 0; i < workers; i++) {
+		cursors[i].span = (TZ_Lookup){.valid_from = 1, .valid_until = 0};
+	}
+
+	Convert_Job job = {.tz = tz, .utc = utc, .local = local, .count = count, .cursors = cursors};
+	tz_pool_run(pool, convert_chunk, &job, chunks);
+	free(cursors);
+}
@@ -1,8 +1,27 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+// Define LIBTZ_IMPLEMENTATION in one C file before including libtz.h to
+// build the library into that file instead of linking libtz.c. LIBTZ_STATIC
+// goes further and makes every function static inline, so the compiler can
+// inline conversions into the caller's loops; each file built that way gets
+// its own copy of the library, including the registry and caches
+#if defined(LIBTZ_STATIC)
+#define TZ_DEF static inline
+#ifndef LIBTZ_IMPLEMENTATION
+#define LIBTZ_IMPLEMENTATION
+#endif
+#else
+#define TZ_DEF extern
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef enum {
 	TZ_No_Leap,
 	TZ_Leap,
@@ -38,15 +57,40 @@ typedef struct {
 	bool dst;
 } TZ_Record;
 
+typedef struct {
+	int64_t time;
+	int64_t tai_offset;
+} TZ_Leapsecond;
+
+typedef enum {
+	TZ_Region_Table,
+	TZ_Region_Rule,
+	TZ_Region_Fixed,
+} TZ_Region_Kind;
+
+typedef struct TZ_Day_Entry TZ_Day_Entry;
+typedef struct TZ_Transition_Blocks TZ_Transition_Blocks;
+
 typedef struct {
 	char *name;
+	TZ_Region_Kind kind;
 
 	TZ_Record *records;
 	int64_t record_count;
 	char **shortnames;
 	int64_t shortname_count;
+	TZ_Leapsecond *leapseconds;
+	int64_t leapsecond_count;
 
 	TZ_RRule rrule;
+
+	// Optional, filled in by tz_region_build_day_table
+	TZ_Day_Entry *days;
+	int64_t day_base;
+	int64_t day_count;
+
+	// Optional, filled in by tz_region_compress, which frees records
+	TZ_Transition_Blocks *blocks;
 } TZ_Region;
 
 typedef struct {
@@ -66,22 +110,283 @@ typedef struct {
 	TZ_Region *tz;
 } TZ_Time;
 
-bool tz_region_load(char *region_name, TZ_Region **region);
-bool tz_region_load_local(bool check_env, TZ_Region **region);
-bool tz_region_load_from_file(char *file_path, char *reg_str, TZ_Region **region);
-bool tz_region_load_from_buffer(uint8_t *buffer, size_t sz, char *reg_str, TZ_Region **region);
-bool tz_parse_posix_tz(char *posix_tz, int tz_str_len, TZ_RRule *rrule);
+typedef struct {
+	int64_t utc_offset;
+	bool dst;
+	char *shortname;
+
+	int64_t valid_from;
+	int64_t valid_until;
+} TZ_Lookup;
+
+typedef struct TZ_Parser TZ_Parser;
+
+typedef struct {
+	TZ_Leapsecond *table;
+	int64_t count;
+	int64_t idx;
+} TZ_Leap_Cursor;
+
+typedef struct {
+	int8_t hours;
+	int8_t minutes;
+	int8_t seconds;
+	int32_t nanoseconds;
+} TZ_HMS_Ns;
 
-void tz_region_destroy(TZ_Region *region);
+// Everything needed to print a TZ_Time, from a single region lookup
+typedef struct {
+	TZ_Date date;
+	TZ_HMS hms;
+	int8_t weekday;   // 0 is Sunday
+	int16_t year_day; // 0 is January 1st
+	int64_t utc_offset;
+	bool dst;
+	char *shortname;
+} TZ_Breakdown;
+
+typedef struct {
+	int64_t time;
+	TZ_Region *tz;
+} TZ_Time_Ns;
+
+// UTC seconds in the low 52 bits, and a tz_registry zone id in the high 12
+#define TZ_PACKED_MAX_ZONES 4096
+
+typedef struct {
+	uint64_t bits;
+} TZ_Packed;
+
+// Longest stamp a TZ_Stamp_Cache will hold, counting the terminator
+#define TZ_STAMP_MAX_LEN 64
+
+typedef struct TZ_Stamp_Cache TZ_Stamp_Cache;
+
+// Called once a background load finishes, with ok == false if it failed;
+// region is owned by the shared cache and must not be destroyed
+typedef void (*TZ_Load_Fn)(void *user, char *region_name, TZ_Region *region, bool ok);
+
+typedef enum {
+	TZ_Bucket_Day,
+	TZ_Bucket_ISO_Week,
+	TZ_Bucket_Month,
+} TZ_Bucket_Unit;
+
+typedef enum {
+	TZ_Fold_Earlier,
+	TZ_Fold_Later,
+} TZ_Fold_Policy;
+
+typedef enum {
+	TZ_Gap_Shift_Forward, // 02:30 in a skipped 02:00-03:00 becomes 03:30
+	TZ_Gap_Next_Valid,    // 02:30 in a skipped 02:00-03:00 becomes 03:00
+	TZ_Gap_Reject,
+} TZ_Gap_Policy;
+
+typedef struct {
+	TZ_Fold_Policy fold;
+	TZ_Gap_Policy gap;
+} TZ_Resolve_Policy;
+
+// Years, months and days count on the wall clock, the rest as elapsed time
+typedef struct {
+	int64_t years;
+	int64_t months;
+	int64_t days;
+	int64_t hours;
+	int64_t minutes;
+	int64_t seconds;
+} TZ_Period;
+
+// One column per component, as they come out of columnar feeds
+typedef struct {
+	int32_t *year;
+	int32_t *month;
+	int32_t *day;
+	int32_t *hour;
+	int32_t *minute;
+	int32_t *second;
+} TZ_Component_Columns;
+
+typedef struct TZ_Zone_Pair TZ_Zone_Pair;
+
+typedef struct {
+	TZ_Zone_Pair *pair;
+	int64_t idx;
+} TZ_Zone_Pair_Cursor;
+
+typedef struct TZ_Pool TZ_Pool;
+typedef struct TZ_Zone_Index TZ_Zone_Index;
+typedef struct TZ_Tzdata TZ_Tzdata;
+typedef struct TZ_World_Clock TZ_World_Clock;
+typedef struct TZ_Abbrev_Index TZ_Abbrev_Index;
+
+// One zone's use of an abbreviation; zone is its position in the list the index was built from
+typedef struct {
+	TZ_Region *tz;
+	int64_t zone;
+	int64_t utc_offset;
+	bool dst;
+	int64_t valid_from;
+	int64_t valid_until;
+} TZ_Abbrev_Match;
+
+// Runs one task; worker is in [0, worker_count) and is never shared by two
+// tasks running at the same time, so it can index per-worker state
+typedef void (*TZ_Task_Fn)(void *ctx, int64_t task, int32_t worker);
+
+// Lets a pool hand its tasks to an existing scheduler; must call fn for every
+// task in [0, task_count) and return once they've all finished
+typedef void (*TZ_Pool_Run_Fn)(void *user, TZ_Task_Fn fn, void *ctx, int64_t task_count);
+
+TZ_DEF bool tz_region_load(char *region_name, TZ_Region **region);
+TZ_DEF bool tz_region_load_local(bool check_env, TZ_Region **region);
+TZ_DEF bool tz_region_load_from_file(char *file_path, char *reg_str, TZ_Region **region);
+TZ_DEF bool tz_region_load_from_buffer(uint8_t *buffer, size_t sz, char *reg_str, TZ_Region **region);
+TZ_DEF bool tz_region_load_from_fd(int fd, char *reg_str, TZ_Region **region);
+TZ_DEF bool tz_region_from_posix(char *posix_tz, TZ_Region **region);
+TZ_DEF bool tz_parse_posix_tz(char *posix_tz, int tz_str_len, TZ_RRule *rrule);
+
+TZ_DEF bool tz_parser_create(char *reg_str, TZ_Parser **parser);
+TZ_DEF bool tz_parser_feed(TZ_Parser *parser, uint8_t *chunk, size_t len);
+TZ_DEF bool tz_parser_finish(TZ_Parser *parser, TZ_Region **region);
+TZ_DEF void tz_parser_destroy(TZ_Parser *parser);
+
+TZ_DEF bool tz_region_build_day_table(TZ_Region *region, int64_t from_year, int64_t to_year);
+TZ_DEF bool   tz_region_compress(TZ_Region *region);
+TZ_DEF size_t tz_region_table_size(TZ_Region *region);
+
+TZ_DEF bool tz_region_load_async(char *region_name, TZ_Load_Fn fn, void *user);
+TZ_DEF bool tz_prefetch(char **region_names, int64_t count);
+TZ_DEF bool tz_region_cached(char *region_name, TZ_Region **region);
+
+TZ_DEF void tz_region_destroy(TZ_Region *region);
 void tz_rrule_destroy(TZ_RRule *rrule);
 
-TZ_Time tz_time_from_unix_seconds(int64_t time);
-TZ_Time tz_time_from_components(TZ_Date date, TZ_HMS hms, TZ_Region *tz);
-TZ_Time tz_time_to_utc(TZ_Time t);
-TZ_Time tz_time_to_tz(TZ_Time in_t, TZ_Region *tz);
-int64_t tz_time_to_unix_seconds(TZ_Time t);
+TZ_DEF TZ_Time tz_time_from_unix_seconds(int64_t time);
+TZ_DEF TZ_Time tz_time_from_components(TZ_Date date, TZ_HMS hms, TZ_Region *tz);
+TZ_DEF TZ_Time tz_time_to_utc(TZ_Time t);
+TZ_DEF TZ_Time tz_time_to_tz(TZ_Time in_t, TZ_Region *tz);
+TZ_DEF int64_t tz_time_to_unix_seconds(TZ_Time t);
+
+TZ_DEF TZ_Date tz_get_date(TZ_Time t);
+TZ_DEF TZ_HMS  tz_get_hms(TZ_Time t);
+TZ_DEF char *tz_shortname(TZ_Time t);
+TZ_DEF bool  tz_is_dst(TZ_Time t);
+TZ_DEF void  tz_breakdown(TZ_Time t, TZ_Breakdown *out);
+
+TZ_DEF void tz_lookup(TZ_Region *tz, int64_t utc, TZ_Lookup *info);
+TZ_DEF void tz_convert_batch(TZ_Region *tz, int64_t *utc, int64_t *local, int64_t count);
+TZ_DEF void tz_convert_mixed(TZ_Region **zones, int64_t *utc, int64_t *local, int64_t count);
+
+TZ_DEF bool       tz_world_clock_create(TZ_Region **zones, int64_t count, int64_t utc, TZ_World_Clock **clock);
+TZ_DEF void       tz_world_clock_destroy(TZ_World_Clock *clock);
+TZ_DEF int64_t    tz_world_clock_advance(TZ_World_Clock *clock, int64_t utc);
+TZ_DEF int64_t   *tz_world_clock_changed(TZ_World_Clock *clock);
+TZ_DEF TZ_Lookup *tz_world_clock_states(TZ_World_Clock *clock);
+TZ_DEF int64_t    tz_world_clock_next(TZ_World_Clock *clock);
+
+TZ_DEF TZ_Region *tz_local_region(void);
+TZ_DEF TZ_Time    tz_now_local(void);
+TZ_DEF TZ_Time_Ns tz_now_local_ns(void);
+
+TZ_DEF TZ_Time_Ns tz_time_ns_from_unix_ns(int64_t time);
+TZ_DEF TZ_Time_Ns tz_time_ns_from_time(TZ_Time t, int32_t nanoseconds);
+TZ_DEF TZ_Time    tz_time_ns_to_time(TZ_Time_Ns t);
+TZ_DEF TZ_Time_Ns tz_time_ns_to_utc(TZ_Time_Ns t);
+TZ_DEF TZ_Time_Ns tz_time_ns_to_tz(TZ_Time_Ns in_t, TZ_Region *tz);
+TZ_DEF int64_t    tz_time_ns_to_unix_ns(TZ_Time_Ns t);
+
+TZ_DEF TZ_Date   tz_get_date_ns(TZ_Time_Ns t);
+TZ_DEF TZ_HMS_Ns tz_get_hms_ns(TZ_Time_Ns t);
+
+TZ_DEF void tz_convert_ns_batch(TZ_Region *tz, int64_t *utc_ns, int64_t *local_ns, int64_t count);
+
+TZ_DEF size_t tz_format(TZ_Time t, char *fmt, char *buf, size_t buf_sz);
+TZ_DEF size_t tz_format_ns(TZ_Time_Ns t, char *fmt, char *buf, size_t buf_sz);
+
+TZ_DEF bool   tz_stamp_cache_create(TZ_Region *tz, char *fmt, TZ_Stamp_Cache **cache);
+TZ_DEF void   tz_stamp_cache_destroy(TZ_Stamp_Cache *cache);
+TZ_DEF size_t tz_stamp_format(TZ_Stamp_Cache *cache, int64_t utc_ns, char *buf, size_t buf_sz);
+TZ_DEF size_t tz_stamp_now(TZ_Stamp_Cache *cache, char *buf, size_t buf_sz);
+
+TZ_DEF int64_t tz_utc_to_tai(TZ_Region *tz, int64_t utc);
+TZ_DEF int64_t tz_tai_to_utc(TZ_Region *tz, int64_t tai, bool *is_leap);
+TZ_DEF void tz_utc_to_tai_batch(TZ_Region *tz, int64_t *utc, int64_t *tai, int64_t count);
+TZ_DEF void tz_tai_to_utc_batch(TZ_Region *tz, int64_t *tai, int64_t *utc, int64_t count);
+
+TZ_DEF void    tz_leap_cursor_init(TZ_Leap_Cursor *cursor, TZ_Region *tz);
+TZ_DEF int64_t tz_leap_cursor_utc_to_tai(TZ_Leap_Cursor *cursor, int64_t utc);
+TZ_DEF int64_t tz_leap_cursor_tai_to_utc(TZ_Leap_Cursor *cursor, int64_t tai, bool *is_leap);
+
+TZ_DEF bool    tz_pool_create(int32_t thread_count, TZ_Pool **pool);
+TZ_DEF bool    tz_pool_create_custom(int32_t worker_count, TZ_Pool_Run_Fn run, void *user, TZ_Pool **pool);
+TZ_DEF void    tz_pool_destroy(TZ_Pool *pool);
+TZ_DEF int32_t tz_pool_worker_count(TZ_Pool *pool);
+TZ_DEF void    tz_pool_run(TZ_Pool *pool, TZ_Task_Fn fn, void *ctx, int64_t task_count);
+
+TZ_DEF void tz_convert_parallel(TZ_Region *tz, int64_t *utc, int64_t *local, int64_t count, TZ_Pool *pool);
+
+TZ_DEF bool    tz_zone_index_build(char *zoneinfo_dir, TZ_Zone_Index **index);
+TZ_DEF void    tz_zone_index_destroy(TZ_Zone_Index *index);
+TZ_DEF bool    tz_zone_index_find(TZ_Zone_Index *index, char *name, int32_t *zone_id);
+TZ_DEF char   *tz_zone_index_name(TZ_Zone_Index *index, int32_t zone_id);
+TZ_DEF int32_t tz_zone_index_count(TZ_Zone_Index *index);
+
+TZ_DEF bool    tz_tzdata_load(char *path, TZ_Tzdata **db);
+TZ_DEF bool    tz_tzdata_load_from_buffer(uint8_t *buffer, size_t sz, TZ_Tzdata **db);
+TZ_DEF void    tz_tzdata_destroy(TZ_Tzdata *db);
+TZ_DEF bool    tz_tzdata_region(TZ_Tzdata *db, char *name, TZ_Region **region);
+TZ_DEF int64_t tz_tzdata_count(TZ_Tzdata *db);
+TZ_DEF char   *tz_tzdata_name(TZ_Tzdata *db, int64_t idx);
+TZ_DEF char   *tz_tzdata_version(TZ_Tzdata *db);
+
+TZ_DEF bool    tz_abbrev_index_build(TZ_Region **zones, int64_t count, TZ_Abbrev_Index **index);
+TZ_DEF void    tz_abbrev_index_destroy(TZ_Abbrev_Index *index);
+TZ_DEF bool    tz_abbrev_offset(TZ_Abbrev_Index *index, char *abbrev, int abbrev_len, int64_t approx_utc, int64_t *utc_offset, bool *dst);
+TZ_DEF int64_t tz_abbrev_candidates(TZ_Abbrev_Index *index, char *abbrev, int abbrev_len, int64_t approx_utc, TZ_Abbrev_Match *matches, int64_t cap);
+
+TZ_DEF bool       tz_registry_add(TZ_Region *tz, uint16_t *zone_id);
+TZ_DEF bool       tz_registry_set(uint16_t zone_id, TZ_Region *tz);
+TZ_DEF TZ_Region *tz_registry_get(uint16_t zone_id);
+
+TZ_DEF bool      tz_pack(int64_t utc, uint16_t zone_id, TZ_Packed *out);
+TZ_DEF bool      tz_pack_time(TZ_Time t, TZ_Packed *out);
+TZ_DEF int64_t   tz_packed_unix_seconds(TZ_Packed p);
+TZ_DEF uint16_t  tz_packed_zone_id(TZ_Packed p);
+TZ_DEF TZ_Packed tz_packed_to_zone(TZ_Packed p, uint16_t zone_id);
+TZ_DEF TZ_Time   tz_packed_to_time(TZ_Packed p);
+TZ_DEF TZ_Date   tz_packed_get_date(TZ_Packed p);
+TZ_DEF TZ_HMS    tz_packed_get_hms(TZ_Packed p);
+TZ_DEF size_t    tz_packed_format(TZ_Packed p, char *fmt, char *buf, size_t buf_sz);
+
+TZ_DEF bool tz_pack_batch(int64_t *utc, uint16_t zone_id, TZ_Packed *out, int64_t count);
+TZ_DEF void tz_packed_local_batch(TZ_Packed *in, int64_t *local, int64_t count);
+
+TZ_DEF bool    tz_local_to_utc(TZ_Region *tz, int64_t local, TZ_Resolve_Policy policy, int64_t *utc);
+TZ_DEF int     tz_local_candidates(TZ_Region *tz, int64_t local, TZ_Lookup spans[2]);
+TZ_DEF int64_t tz_components_to_utc_batch(TZ_Region *tz, TZ_Component_Columns *cols, TZ_Resolve_Policy policy, int64_t *out_utc, int64_t count);
+
+TZ_DEF bool    tz_add(TZ_Time t, TZ_Period period, TZ_Resolve_Policy policy, TZ_Time *out);
+TZ_DEF int64_t tz_add_batch(TZ_Region *tz, int64_t *local, TZ_Period period, TZ_Resolve_Policy policy, int64_t *out_local, int64_t count);
+TZ_DEF int64_t tz_add_series(TZ_Time start, TZ_Period step, TZ_Resolve_Policy policy, int64_t *out_local, int64_t count);
+TZ_DEF bool    tz_diff_calendar(TZ_Time from, TZ_Time to, TZ_Resolve_Policy policy, TZ_Period *out);
+TZ_DEF int64_t tz_diff_calendar_batch(TZ_Region *tz, int64_t *from_local, int64_t *to_local, TZ_Resolve_Policy policy, TZ_Period *out, int64_t count);
+
+TZ_DEF bool    tz_zone_pair_create(TZ_Region *from, TZ_Region *to, TZ_Zone_Pair **pair);
+TZ_DEF void    tz_zone_pair_destroy(TZ_Zone_Pair *pair);
+TZ_DEF TZ_Time tz_zone_pair_convert(TZ_Zone_Pair *pair, TZ_Time t);
+TZ_DEF void    tz_zone_pair_convert_batch(TZ_Zone_Pair *pair, int64_t *in, int64_t *out, int64_t count);
+TZ_DEF void    tz_zone_pair_cursor_init(TZ_Zone_Pair_Cursor *cursor, TZ_Zone_Pair *pair);
+TZ_DEF int64_t tz_zone_pair_cursor_convert(TZ_Zone_Pair_Cursor *cursor, int64_t t);
+
+TZ_DEF void    tz_bucket_batch(TZ_Region *tz, TZ_Bucket_Unit unit, int64_t *utc, int64_t *out_keys, int64_t *out_bucket_start_utc, int64_t count);
+TZ_DEF TZ_Date tz_bucket_date(TZ_Bucket_Unit unit, int64_t key);
+
+#ifdef __cplusplus
+}
+#endif
 
-TZ_Date tz_get_date(TZ_Time t);
-TZ_HMS  tz_get_hms(TZ_Time t);
-char *tz_shortname(TZ_Time t);
-bool  tz_is_dst(TZ_Time t);
+#if defined(LIBTZ_IMPLEMENTATION)
+#include "libtz.c"
+#endif
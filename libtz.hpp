@@ -0,0 +1,373 @@
+#pragma once
+
+// Header-only C++20 layer over libtz.h
+// Zones are loaded one at a time, as they're asked for, rather than parsing the whole tzdb up front
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "libtz.h"
+
+#if defined(__cpp_lib_chrono) && __cpp_lib_chrono >= 201907L
+#define LIBTZ_STD_TZDB 1
+#endif
+
+namespace libtz {
+
+namespace chrono = std::chrono;
+
+template <class Duration>
+using sys_time = chrono::sys_time<Duration>;
+template <class Duration>
+using local_time = chrono::local_time<Duration>;
+
+#if defined(LIBTZ_STD_TZDB)
+using sys_info   = chrono::sys_info;
+using local_info = chrono::local_info;
+using choose     = chrono::choose;
+#else
+// Stand-ins with the same shape as the C++20 types, for standard libraries that don't ship them yet
+struct sys_info {
+	chrono::sys_seconds begin;
+	chrono::sys_seconds end;
+	chrono::seconds offset;
+	chrono::minutes save;
+	std::string abbrev;
+};
+
+struct local_info {
+	static constexpr int unique      = 0;
+	static constexpr int nonexistent = 1;
+	static constexpr int ambiguous   = 2;
+
+	int result;
+	sys_info first;
+	sys_info second;
+};
+
+enum class choose { earliest, latest };
+#endif
+
+class nonexistent_local_time : public std::runtime_error {
+public:
+	nonexistent_local_time() : std::runtime_error("local time falls in a transition gap") {}
+};
+
+class ambiguous_local_time : public std::runtime_error {
+public:
+	ambiguous_local_time() : std::runtime_error("local time occurs twice") {}
+};
+
+namespace detail {
+	inline chrono::sys_seconds to_sys_seconds(int64_t t) {
+		if (t == INT64_MIN) return chrono::sys_seconds::min();
+		if (t == INT64_MAX) return chrono::sys_seconds::max();
+		return chrono::sys_seconds{chrono::seconds{t}};
+	}
+
+	// DST saves the difference from the standard time on either side of it (30
+	// minutes on Lord Howe); when neither neighbour is standard time it's left 0,
+	// as libstdc++ does when it can't tell
+	inline chrono::minutes dst_save(TZ_Region *tz, const TZ_Lookup &span) {
+		if (!span.dst) {
+			return chrono::minutes{0};
+		}
+
+		TZ_Lookup next;
+		if (span.valid_from != INT64_MIN) {
+			tz_lookup(tz, span.valid_from - 1, &next);
+			if (!next.dst) {
+				return chrono::duration_cast<chrono::minutes>(chrono::seconds{span.utc_offset - next.utc_offset});
+			}
+		}
+		if (span.valid_until != INT64_MAX) {
+			tz_lookup(tz, span.valid_until, &next);
+			if (!next.dst) {
+				return chrono::duration_cast<chrono::minutes>(chrono::seconds{span.utc_offset - next.utc_offset});
+			}
+		}
+		return chrono::minutes{0};
+	}
+
+	inline sys_info to_sys_info(TZ_Region *tz, const TZ_Lookup &span) {
+		sys_info info{};
+		info.begin  = to_sys_seconds(span.valid_from);
+		info.end    = to_sys_seconds(span.valid_until);
+		info.offset = chrono::seconds{span.utc_offset};
+		info.save   = dst_save(tz, span);
+		info.abbrev = span.shortname;
+		return info;
+	}
+
+	// The spans a local time maps into, from tz_local_candidates; count is 0 in a gap,
+	// where spans are the ones on either side of it
+	struct local_candidates {
+		int count;
+		TZ_Lookup spans[2];
+	};
+}
+
+// Owning handle for a TZ_Region, a null region is UTC
+class region {
+public:
+	region() = default;
+
+	explicit region(const char *name) {
+		if (!tz_region_load(const_cast<char *>(name), &ptr_)) {
+			throw std::runtime_error(std::string("libtz: unable to load ") + name);
+		}
+	}
+
+	static region from_posix(const char *posix_tz) {
+		region r;
+		if (!tz_region_from_posix(const_cast<char *>(posix_tz), &r.ptr_)) {
+			throw std::runtime_error(std::string("libtz: invalid POSIX TZ string ") + posix_tz);
+		}
+		return r;
+	}
+
+	static region adopt(TZ_Region *ptr) {
+		region r;
+		r.ptr_ = ptr;
+		return r;
+	}
+
+	region(const region &) = delete;
+	region &operator=(const region &) = delete;
+
+	region(region &&other) noexcept : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+	region &operator=(region &&other) noexcept {
+		if (this != &other) {
+			tz_region_destroy(ptr_);
+			ptr_ = other.ptr_;
+			other.ptr_ = nullptr;
+		}
+		return *this;
+	}
+
+	~region() { tz_region_destroy(ptr_); }
+
+	TZ_Region *get() const { return ptr_; }
+	TZ_Region *release() {
+		TZ_Region *ptr = ptr_;
+		ptr_ = nullptr;
+		return ptr;
+	}
+
+private:
+	TZ_Region *ptr_ = nullptr;
+};
+
+// Usable anywhere a const std::chrono::time_zone * is, including as the TimeZonePtr of zoned_time
+class time_zone {
+public:
+	time_zone(std::string name, region reg) : name_(std::move(name)), owned_(std::move(reg)), tz_(owned_.get()), id_(next_id()) {}
+
+	// Wraps a region owned elsewhere, like the shared local region
+	time_zone(std::string name, TZ_Region *borrowed) : name_(std::move(name)), tz_(borrowed), id_(next_id()) {}
+
+	std::string_view name() const noexcept { return name_; }
+	TZ_Region *get() const noexcept { return tz_; }
+
+	template <class Duration>
+	sys_info get_info(sys_time<Duration> tp) const {
+		return detail::to_sys_info(tz_, lookup(chrono::floor<chrono::seconds>(tp).time_since_epoch().count()));
+	}
+
+	template <class Duration>
+	local_info get_info(local_time<Duration> tp) const {
+		int64_t local = chrono::floor<chrono::seconds>(tp).time_since_epoch().count();
+		detail::local_candidates c = resolve(local);
+
+		local_info info{};
+		info.first = detail::to_sys_info(tz_, c.spans[0]);
+		if (c.count == 1) {
+			info.result = local_info::unique;
+		} else {
+			info.result = (c.count == 2) ? local_info::ambiguous : local_info::nonexistent;
+			info.second = detail::to_sys_info(tz_, c.spans[1]);
+		}
+		return info;
+	}
+
+	template <class Duration>
+	sys_time<std::common_type_t<Duration, chrono::seconds>> to_sys(local_time<Duration> tp) const {
+		int64_t local = chrono::floor<chrono::seconds>(tp).time_since_epoch().count();
+		detail::local_candidates c = resolve(local);
+		if (c.count == 0) throw nonexistent_local_time();
+		if (c.count == 2) throw ambiguous_local_time();
+		return sys_time<std::common_type_t<Duration, chrono::seconds>>{tp.time_since_epoch() - chrono::seconds{c.spans[0].utc_offset}};
+	}
+
+	template <class Duration>
+	sys_time<std::common_type_t<Duration, chrono::seconds>> to_sys(local_time<Duration> tp, choose z) const {
+		using out_time = sys_time<std::common_type_t<Duration, chrono::seconds>>;
+		int64_t local = chrono::floor<chrono::seconds>(tp).time_since_epoch().count();
+		detail::local_candidates c = resolve(local);
+
+		if (c.count == 1) {
+			return out_time{tp.time_since_epoch() - chrono::seconds{c.spans[0].utc_offset}};
+		}
+		if (c.count == 2) {
+			TZ_Lookup &span = (z == choose::earliest) ? c.spans[0] : c.spans[1];
+			return out_time{tp.time_since_epoch() - chrono::seconds{span.utc_offset}};
+		}
+
+		// Both choices land on the transition itself
+		return out_time{detail::to_sys_seconds(c.spans[1].valid_from)};
+	}
+
+	template <class Duration>
+	local_time<std::common_type_t<Duration, chrono::seconds>> to_local(sys_time<Duration> tp) const {
+		TZ_Lookup span = lookup(chrono::floor<chrono::seconds>(tp).time_since_epoch().count());
+		return local_time<std::common_type_t<Duration, chrono::seconds>>{tp.time_since_epoch() + chrono::seconds{span.utc_offset}};
+	}
+
+private:
+	// Away from transitions, a local time can only belong to the span its naive guess lands in
+	detail::local_candidates resolve(int64_t local) const {
+		const int64_t day = 24 * 60 * 60;
+
+		TZ_Lookup guess = lookup(local);
+		TZ_Lookup span = lookup(local - guess.utc_offset);
+		int64_t utc = local - span.utc_offset;
+		detail::local_candidates out{};
+		if (utc >= span.valid_from + (2 * day) && utc < span.valid_until - (2 * day)) {
+			out.count = 1;
+			out.spans[0] = span;
+			return out;
+		}
+
+		out.count = tz_local_candidates(tz_, local, out.spans);
+		return out;
+	}
+
+	// Ids are never reused, so a zone built where a destroyed one lived can't pick up its spans
+	static uint64_t next_id() {
+		static std::atomic<uint64_t> counter{0};
+		return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	// Each thread remembers the last span it looked up for a handful of zones, so
+	// runs of nearby times skip the search even when they alternate between zones
+	TZ_Lookup lookup(int64_t utc) const {
+		struct last_lookup {
+			uint64_t id;
+			TZ_Lookup span;
+		};
+		thread_local last_lookup cache[8] = {};
+
+		last_lookup &last = cache[id_ % 8];
+		if (last.id != id_ || utc < last.span.valid_from || utc >= last.span.valid_until) {
+			tz_lookup(tz_, utc, &last.span);
+			last.id = id_;
+		}
+		return last.span;
+	}
+
+	std::string name_;
+	region owned_;
+	TZ_Region *tz_ = nullptr;
+	uint64_t id_ = 0;
+};
+
+// Zones get loaded on first use and then live for the rest of the process
+inline const time_zone *locate_zone(std::string_view name) {
+	static std::mutex lock;
+	static std::map<std::string, std::unique_ptr<time_zone>, std::less<>> zones;
+
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = zones.find(name);
+	if (it != zones.end()) {
+		return it->second.get();
+	}
+
+	std::string key(name);
+	region reg(key.c_str());
+	auto zone = std::make_unique<time_zone>(key, std::move(reg));
+	const time_zone *out = zone.get();
+	zones.emplace(std::move(key), std::move(zone));
+	return out;
+}
+
+inline const time_zone *current_zone() {
+	static time_zone local("localtime", tz_local_region());
+	return &local;
+}
+
+// A zone that never changes offset, everything about it can be worked out at compile time
+class fixed_zone {
+public:
+	constexpr explicit fixed_zone(chrono::seconds offset) : offset_(offset) {
+		int64_t off = offset.count();
+		name_[name_len_++] = (off < 0) ? '-' : '+';
+		if (off < 0) off = -off;
+
+		int64_t hours = off / 3600;
+		int64_t minutes = (off % 3600) / 60;
+		name_[name_len_++] = (char)('0' + (hours / 10));
+		name_[name_len_++] = (char)('0' + (hours % 10));
+		name_[name_len_++] = ':';
+		name_[name_len_++] = (char)('0' + (minutes / 10));
+		name_[name_len_++] = (char)('0' + (minutes % 10));
+	}
+
+	constexpr std::string_view name() const noexcept { return std::string_view(name_, name_len_); }
+	constexpr chrono::seconds offset() const noexcept { return offset_; }
+
+	template <class Duration>
+	constexpr local_time<std::common_type_t<Duration, chrono::seconds>> to_local(sys_time<Duration> tp) const {
+		return local_time<std::common_type_t<Duration, chrono::seconds>>{tp.time_since_epoch() + offset_};
+	}
+
+	template <class Duration>
+	constexpr sys_time<std::common_type_t<Duration, chrono::seconds>> to_sys(local_time<Duration> tp) const {
+		return sys_time<std::common_type_t<Duration, chrono::seconds>>{tp.time_since_epoch() - offset_};
+	}
+
+	template <class Duration>
+	constexpr sys_time<std::common_type_t<Duration, chrono::seconds>> to_sys(local_time<Duration> tp, choose) const {
+		return to_sys(tp);
+	}
+
+	template <class Duration>
+	sys_info get_info(sys_time<Duration>) const {
+		sys_info info{};
+		info.begin  = chrono::sys_seconds::min();
+		info.end    = chrono::sys_seconds::max();
+		info.offset = offset_;
+		info.save   = chrono::minutes{0};
+		info.abbrev = std::string(name());
+		return info;
+	}
+
+	template <class Duration>
+	local_info get_info(local_time<Duration> tp) const {
+		local_info info{};
+		info.result = local_info::unique;
+		info.first  = get_info(sys_time<Duration>{tp.time_since_epoch()});
+		return info;
+	}
+
+private:
+	chrono::seconds offset_;
+	char name_[8] = {};
+	size_t name_len_ = 0;
+};
+
+}
+
+#if defined(LIBTZ_STD_TZDB)
+template <>
+struct std::chrono::zoned_traits<const libtz::time_zone *> {
+	static const libtz::time_zone *default_zone() { return libtz::locate_zone("UTC"); }
+	static const libtz::time_zone *locate_zone(std::string_view name) { return libtz::locate_zone(name); }
+};
+#endif
@@ -1,47 +1,693 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <time.h>
 
+#if !defined(_WIN64) && !defined(_WIN32)
+#define USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "libtz.h"
 
-void print_time(TZ_Time t) {
-	TZ_Date date = tz_get_date(t);
-	TZ_HMS hms = tz_get_hms(t);
-	printf("%02d-%02d-%04lld @ %02d:%02d:%02d %s\n",
-		date.month, date.day,    date.year,
-		hms.hours,  hms.minutes, hms.seconds,
-		tz_shortname(t)
+#define BLOCK_SIZE (64 * 1024 * 1024)
+#define MIN_CHUNK_SIZE (256 * 1024)
+#define CHUNKS_PER_THREAD 4
+#define MAX_STAMP_LEN 128
+
+typedef struct {
+	TZ_Region *from;
+	TZ_Region *to;
+	int64_t column;
+	char delimiter;
+	char *format;
+	int64_t unit_ns;
+	int32_t threads;
+	bool stats;
+	char *path;
+} Options;
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+} Out_Buf;
+
+typedef struct {
+	char *start;
+	size_t len;
+	Out_Buf out;
+	int64_t lines;
+	int64_t converted;
+} Chunk;
+
+typedef struct {
+	Options *opts;
+	Chunk *chunks;
+} Block_Job;
+
+typedef struct {
+	int64_t bytes;
+	int64_t lines;
+	int64_t converted;
+} Stats;
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: tzload [options] [file]\n"
+		"Rewrites the timestamps found in one column of each line, reading stdin when no file is given\n"
+		"\n"
+		"  --from ZONE       zone for ISO timestamps without an offset (default UTC)\n"
+		"  --to ZONE         zone to convert into (default local)\n"
+		"  --column N        1-based column holding the timestamp (default 1)\n"
+		"  --delimiter C     column separator, \\t for tab (default ,)\n"
+		"  --format FMT      tz_format output format (default %%FT%%T%%:z)\n"
+		"  --unit U          unit of epoch timestamps: s, ms, us or ns (default s)\n"
+		"  --threads N       worker threads, 0 for one per CPU (default 1)\n"
+		"  --stats           print a throughput report to stderr\n"
+		"\n"
+		"Epoch values and ISO 8601 dates (YYYY-MM-DD[T ]HH:MM[:SS[.frac]][Z|+HH:MM]) are recognized,\n"
+		"anything else is passed through untouched. ZONE is an IANA name, UTC or local.\n"
 	);
 }
 
+static bool load_zone(char *name, TZ_Region **region) {
+	if (strcmp(name, "UTC") == 0) {
+		*region = NULL;
+		return true;
+	}
+	if (strcmp(name, "local") == 0) {
+		*region = tz_local_region();
+		return *region != NULL;
+	}
+	return tz_region_load(name, region);
+}
+
+static void free_zone(TZ_Region *region) {
+	if (region != NULL && region != tz_local_region()) {
+		tz_region_destroy(region);
+	}
+}
+
+static double clock_seconds(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+// SECTION: Timestamp Parsing
+static bool parse_digits(char *str, char *end, int count, int64_t *val) {
+	if (end - str < count) {
+		return false;
+	}
+
+	int64_t v = 0;
+	for (int i = 0; i < count; i++) {
+		if (str[i] < '0' || str[i] > '9') {
+			return false;
+		}
+		v = (v * 10) + (str[i] - '0');
+	}
+	*val = v;
+	return true;
+}
+
+static char *parse_fraction(char *str, char *end, int64_t *nanos) {
+	int64_t ns = 0;
+	int digits = 0;
+	while (str < end && *str >= '0' && *str <= '9') {
+		if (digits < 9) {
+			ns = (ns * 10) + (*str - '0');
+			digits += 1;
+		}
+		str++;
+	}
+	for (; digits < 9; digits++) {
+		ns *= 10;
+	}
+	*nanos = ns;
+	return str;
+}
+
+static bool parse_epoch(Options *opts, char *str, char *end, int64_t *secs, int64_t *nanos) {
+	bool negative = false;
+	if (str < end && *str == '-') {
+		negative = true;
+		str++;
+	}
+
+	int64_t whole = 0;
+	int digits = 0;
+	while (str < end && *str >= '0' && *str <= '9') {
+		int64_t d = *str - '0';
+		if (whole > (INT64_MAX - d) / 10) {
+			return false;
+		}
+		whole = (whole * 10) + d;
+		digits += 1;
+		str++;
+	}
+	if (digits == 0) {
+		return false;
+	}
+
+	int64_t frac = 0;
+	if (str < end && *str == '.') {
+		str = parse_fraction(str + 1, end, &frac);
+	}
+	if (str != end) {
+		return false;
+	}
+
+	// whole and frac are in the input unit; split them into seconds + nanoseconds
+	int64_t per_sec = 1000000000ll / opts->unit_ns;
+	int64_t s  = whole / per_sec;
+	int64_t ns = ((whole % per_sec) * opts->unit_ns) + (frac / per_sec);
+	if (negative) {
+		s  = -s;
+		ns = -ns;
+		if (ns < 0) {
+			s  -= 1;
+			ns += 1000000000ll;
+		}
+	}
+
+	*secs  = s;
+	*nanos = ns;
+	return true;
+}
+
+static bool parse_iso(Options *opts, char *str, char *end, int64_t *secs, int64_t *nanos) {
+	int64_t year, month, day, hour, minute, second = 0, frac = 0;
+	if (!parse_digits(str, end, 4, &year) || str[4] != '-' ||
+		!parse_digits(str + 5, end, 2, &month) || str[7] != '-' ||
+		!parse_digits(str + 8, end, 2, &day)) {
+		return false;
+	}
+	str += 10;
+
+	if (str == end || (*str != 'T' && *str != ' ')) {
+		return false;
+	}
+	str += 1;
+
+	if (!parse_digits(str, end, 2, &hour) || end - str < 5 || str[2] != ':' || !parse_digits(str + 3, end, 2, &minute)) {
+		return false;
+	}
+	str += 5;
+
+	if (str < end && *str == ':') {
+		if (!parse_digits(str + 1, end, 2, &second)) {
+			return false;
+		}
+		str += 3;
+
+		if (str < end && (*str == '.' || *str == ',')) {
+			str = parse_fraction(str + 1, end, &frac);
+		}
+	}
+
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+		return false;
+	}
+
+	TZ_Date date = {.year = year, .month = (int8_t)month, .day = (int8_t)day};
+	TZ_HMS hms = {.hours = (int8_t)hour, .minutes = (int8_t)minute, .seconds = (int8_t)second};
+
+	if (str == end) {
+		*secs  = tz_time_to_unix_seconds(tz_time_from_components(date, hms, opts->from));
+		*nanos = frac;
+		return true;
+	}
+
+	int64_t offset = 0;
+	if (*str == 'Z' || *str == 'z') {
+		str += 1;
+	} else if (*str == '+' || *str == '-') {
+		int64_t sign = (*str == '-') ? -1 : 1;
+		int64_t off_h, off_m = 0;
+		if (!parse_digits(str + 1, end, 2, &off_h)) {
+			return false;
+		}
+		str += 3;
+
+		if (str < end && *str == ':') {
+			str += 1;
+		}
+		if (str < end) {
+			if (!parse_digits(str, end, 2, &off_m)) {
+				return false;
+			}
+			str += 2;
+		}
+		offset = sign * ((off_h * 3600) + (off_m * 60));
+	}
+	if (str != end) {
+		return false;
+	}
+
+	*secs  = tz_time_to_unix_seconds(tz_time_from_components(date, hms, NULL)) - offset;
+	*nanos = frac;
+	return true;
+}
+
+static bool parse_timestamp(Options *opts, char *str, char *end, int64_t *secs, int64_t *nanos) {
+	if (end - str >= 10 && str[4] == '-') {
+		return parse_iso(opts, str, end, secs, nanos);
+	}
+	return parse_epoch(opts, str, end, secs, nanos);
+}
+
+// SECTION: Conversion
+static bool out_reserve(Out_Buf *b, size_t extra) {
+	if (b->len + extra <= b->cap) {
+		return true;
+	}
+
+	size_t cap = (b->cap == 0) ? (1024 * 1024) : b->cap;
+	while (cap < b->len + extra) {
+		cap *= 2;
+	}
+
+	char *data = realloc(b->data, cap);
+	if (data == NULL) {
+		return false;
+	}
+	b->data = data;
+	b->cap  = cap;
+	return true;
+}
+
+static void out_push(Out_Buf *b, char *str, size_t len) {
+	memcpy(b->data + b->len, str, len);
+	b->len += len;
+}
+
+static size_t format_stamp(Options *opts, int64_t secs, int64_t nanos, char *buf, size_t buf_sz) {
+	TZ_Time local = tz_time_to_tz(tz_time_from_unix_seconds(secs), opts->to);
+
+	// TZ_Time_Ns only reaches 1677 to 2262, outside of that the fraction is dropped
+	if (nanos == 0 || secs <= -9200000000ll || secs >= 9200000000ll) {
+		return tz_format(local, opts->format, buf, buf_sz);
+	}
+	return tz_format_ns(tz_time_ns_from_time(local, (int32_t)nanos), opts->format, buf, buf_sz);
+}
+
+static char *find_field(Options *opts, char *line, char *line_end, char **field_end) {
+	char *field = line;
+	for (int64_t col = 1; col < opts->column; col++) {
+		char *next = memchr(field, opts->delimiter, line_end - field);
+		if (next == NULL) {
+			return NULL;
+		}
+		field = next + 1;
+	}
+
+	char *end = memchr(field, opts->delimiter, line_end - field);
+	*field_end = (end == NULL) ? line_end : end;
+	return field;
+}
+
+static void process_chunk(void *ctx, int64_t task, int32_t worker) {
+	Block_Job *job = (Block_Job *)ctx;
+	Options *opts = job->opts;
+	Chunk *chunk = &job->chunks[task];
+
+	chunk->out.len   = 0;
+	chunk->lines     = 0;
+	chunk->converted = 0;
+
+	char stamp[MAX_STAMP_LEN];
+	char *cur = chunk->start;
+	char *end = chunk->start + chunk->len;
+	while (cur < end) {
+		char *nl = memchr(cur, '\n', end - cur);
+		char *line_end = (nl == NULL) ? end : nl;
+		char *next = (nl == NULL) ? end : nl + 1;
+
+		char *content_end = line_end;
+		if (content_end > cur && content_end[-1] == '\r') {
+			content_end -= 1;
+		}
+
+		if (!out_reserve(&chunk->out, (next - cur) + MAX_STAMP_LEN)) {
+			fprintf(stderr, "Out of memory!\n");
+			exit(1);
+		}
+		chunk->lines += 1;
+
+		char *field_end;
+		char *field = find_field(opts, cur, content_end, &field_end);
+
+		int64_t secs, nanos;
+		size_t stamp_len = 0;
+		if (field != NULL && parse_timestamp(opts, field, field_end, &secs, &nanos)) {
+			stamp_len = format_stamp(opts, secs, nanos, stamp, sizeof(stamp));
+		}
+
+		if (stamp_len == 0) {
+			out_push(&chunk->out, cur, next - cur);
+		} else {
+			out_push(&chunk->out, cur, field - cur);
+			out_push(&chunk->out, stamp, stamp_len);
+			out_push(&chunk->out, field_end, next - field_end);
+			chunk->converted += 1;
+		}
+
+		cur = next;
+	}
+}
+
+// Splits a block of whole lines into chunks for the pool, writes them back in
+// order, and returns false if stdout stopped accepting output
+static bool process_block(Options *opts, TZ_Pool *pool, Chunk *chunks, int64_t max_chunks, char *data, size_t len, Stats *stats) {
+	int64_t n = (int64_t)(len / MIN_CHUNK_SIZE) + 1;
+	if (n > max_chunks) {
+		n = max_chunks;
+	}
+
+	size_t target = len / n;
+	char *cur = data;
+	char *end = data + len;
+	int64_t count = 0;
+	while (cur < end) {
+		char *split = (count == n - 1 || (size_t)(end - cur) <= target) ? end : cur + target;
+		if (split < end) {
+			char *nl = memchr(split, '\n', end - split);
+			split = (nl == NULL) ? end : nl + 1;
+		}
+
+		chunks[count].start = cur;
+		chunks[count].len   = split - cur;
+		count += 1;
+		cur = split;
+	}
+
+	Block_Job job = {.opts = opts, .chunks = chunks};
+	tz_pool_run(pool, process_chunk, &job, count);
+
+	for (int64_t i = 0; i < count; i++) {
+		if (fwrite(chunks[i].out.data, 1, chunks[i].out.len, stdout) != chunks[i].out.len) {
+			return false;
+		}
+		stats->lines     += chunks[i].lines;
+		stats->converted += chunks[i].converted;
+	}
+	stats->bytes += len;
+	return true;
+}
+
+// Hands process_block everything up to the last newline that's been read, and
+// carries the partial line over into the next read
+static bool process_stream(Options *opts, TZ_Pool *pool, Chunk *chunks, int64_t max_chunks, FILE *in, Stats *stats) {
+	size_t cap = BLOCK_SIZE;
+	size_t len = 0;
+	char *buf = malloc(cap);
+	if (buf == NULL) {
+		return false;
+	}
+
+	bool ok = true;
+	for (;;) {
+		if (len == cap) {
+			char *grown = realloc(buf, cap * 2);
+			if (grown == NULL) {
+				ok = false;
+				break;
+			}
+			buf = grown;
+			cap *= 2;
+		}
+
+		size_t got = fread(buf + len, 1, cap - len, in);
+		len += got;
+		if (got == 0) {
+			if (ferror(in)) {
+				ok = false;
+			} else if (len > 0) {
+				ok = process_block(opts, pool, chunks, max_chunks, buf, len, stats);
+			}
+			break;
+		}
+
+		char *last_nl = NULL;
+		for (char *p = buf + len; p > buf; p--) {
+			if (p[-1] == '\n') {
+				last_nl = p;
+				break;
+			}
+		}
+		if (last_nl == NULL) {
+			continue;
+		}
+
+		size_t whole = last_nl - buf;
+		if (!process_block(opts, pool, chunks, max_chunks, buf, whole, stats)) {
+			ok = false;
+			break;
+		}
+		memmove(buf, last_nl, len - whole);
+		len -= whole;
+	}
+
+	free(buf);
+	return ok;
+}
+
+#if defined(USE_MMAP)
+static bool process_mapped(Options *opts, TZ_Pool *pool, Chunk *chunks, int64_t max_chunks, int fd, size_t size, Stats *stats) {
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	bool ok = true;
+	size_t pos = 0;
+	while (ok && pos < size) {
+		size_t end = (size - pos > BLOCK_SIZE) ? pos + BLOCK_SIZE : size;
+		if (end < size) {
+			char *nl = memchr(data + end, '\n', size - end);
+			end = (nl == NULL) ? size : (size_t)(nl - data) + 1;
+		}
+
+		ok = process_block(opts, pool, chunks, max_chunks, data + pos, end - pos, stats);
+
+		// Pages behind us won't be read again
+		madvise(data + (pos & ~(size_t)4095), (end - pos) & ~(size_t)4095, MADV_DONTNEED);
+		pos = end;
+	}
+
+	munmap(data, size);
+	return ok;
+}
+#endif
+
+static bool process_input(Options *opts, TZ_Pool *pool, Chunk *chunks, int64_t max_chunks, Stats *stats) {
+	if (opts->path == NULL) {
+		return process_stream(opts, pool, chunks, max_chunks, stdin, stats);
+	}
+
+#if defined(USE_MMAP)
+	int fd = open(opts->path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s!\n", opts->path);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		bool ok = process_mapped(opts, pool, chunks, max_chunks, fd, (size_t)st.st_size, stats);
+		close(fd);
+		return ok;
+	}
+	close(fd);
+#endif
+
+	FILE *in = fopen(opts->path, "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Failed to open %s!\n", opts->path);
+		return false;
+	}
+
+	bool ok = process_stream(opts, pool, chunks, max_chunks, in, stats);
+	fclose(in);
+	return ok;
+}
+
+// SECTION: Arguments
+static bool parse_int_arg(char *str, int64_t min, int64_t *val) {
+	char *end;
+	long long v = strtoll(str, &end, 10);
+	if (end == str || *end != '\0' || v < min) {
+		return false;
+	}
+	*val = v;
+	return true;
+}
+
+static bool parse_args(int argc, char **argv, Options *opts) {
+	char *from = "UTC";
+	char *to = "local";
+
+	for (int i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (strcmp(arg, "--stats") == 0) {
+			opts->stats = true;
+			continue;
+		}
+		if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+			return false;
+		}
+		if (strncmp(arg, "--", 2) != 0 || strcmp(arg, "-") == 0) {
+			if (opts->path != NULL) {
+				fprintf(stderr, "Only one input file can be given\n");
+				return false;
+			}
+			opts->path = (strcmp(arg, "-") == 0) ? NULL : arg;
+			continue;
+		}
+
+		static char *value_opts[] = {"--from", "--to", "--format", "--column", "--threads", "--delimiter", "--unit"};
+		bool known = false;
+		for (size_t j = 0; j < sizeof(value_opts) / sizeof(*value_opts); j++) {
+			known = known || strcmp(arg, value_opts[j]) == 0;
+		}
+		if (!known) {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+		if (i + 1 >= argc) {
+			fprintf(stderr, "%s needs a value\n", arg);
+			return false;
+		}
+		char *val = argv[++i];
+
+		int64_t n;
+		if (strcmp(arg, "--from") == 0) {
+			from = val;
+		} else if (strcmp(arg, "--to") == 0) {
+			to = val;
+		} else if (strcmp(arg, "--format") == 0) {
+			opts->format = val;
+		} else if (strcmp(arg, "--column") == 0) {
+			if (!parse_int_arg(val, 1, &opts->column)) {
+				fprintf(stderr, "Invalid column: %s\n", val);
+				return false;
+			}
+		} else if (strcmp(arg, "--threads") == 0) {
+			if (!parse_int_arg(val, 0, &n) || n > 1024) {
+				fprintf(stderr, "Invalid thread count: %s\n", val);
+				return false;
+			}
+			opts->threads = (int32_t)n;
+		} else if (strcmp(arg, "--delimiter") == 0) {
+			if (strcmp(val, "\\t") == 0) {
+				opts->delimiter = '\t';
+			} else if (strlen(val) == 1) {
+				opts->delimiter = val[0];
+			} else {
+				fprintf(stderr, "The delimiter must be a single character\n");
+				return false;
+			}
+		} else {
+			if      (strcmp(val, "s")  == 0) opts->unit_ns = 1000000000ll;
+			else if (strcmp(val, "ms") == 0) opts->unit_ns = 1000000ll;
+			else if (strcmp(val, "us") == 0) opts->unit_ns = 1000ll;
+			else if (strcmp(val, "ns") == 0) opts->unit_ns = 1ll;
+			else {
+				fprintf(stderr, "Unknown unit: %s\n", val);
+				return false;
+			}
+		}
+	}
+
+	char probe[MAX_STAMP_LEN];
+	if (tz_format(tz_time_from_unix_seconds(0), opts->format, probe, sizeof(probe)) == 0) {
+		fprintf(stderr, "Invalid format: %s\n", opts->format);
+		return false;
+	}
+
+	if (!load_zone(from, &opts->from)) {
+		fprintf(stderr, "Failed to load %s!\n", from);
+		return false;
+	}
+	if (!load_zone(to, &opts->to)) {
+		fprintf(stderr, "Failed to load %s!\n", to);
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char **argv) {
-	TZ_Region *local_region = NULL;
-	if (!tz_region_load_local(true, &local_region)) {
-		printf("Failed to load local region!\n");
+	Options opts = {
+		.column    = 1,
+		.delimiter = ',',
+		.format    = "%FT%T%:z",
+		.unit_ns   = 1000000000ll,
+		.threads   = 1,
+	};
+	if (!parse_args(argc, argv, &opts)) {
+		usage();
 		return 1;
 	}
 
-	TZ_Region *other_region = NULL;
-	if (!tz_region_load((char *)"US/Eastern", &other_region)) {
-		printf("Failed to load %s!\n", "US/Eastern");
+	TZ_Pool *pool = NULL;
+	if (opts.threads != 1 && !tz_pool_create(opts.threads, &pool)) {
+		fprintf(stderr, "Failed to start %d threads!\n", opts.threads);
 		return 1;
 	}
 
-	TZ_Time utc_time   = tz_time_from_components((TZ_Date){2025, 1, 1}, (TZ_HMS){0, 0, 0}, NULL);
-	TZ_Time local_time = tz_time_to_tz(utc_time, local_region);
-	TZ_Time other_time = tz_time_to_tz(local_time, other_region);
-	TZ_Time back_time  = tz_time_to_utc(other_time);
+	int64_t max_chunks = (int64_t)tz_pool_worker_count(pool) * CHUNKS_PER_THREAD;
+	Chunk *chunks = calloc(max_chunks, sizeof(Chunk));
+	if (chunks == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
 
-	print_time(utc_time);
-	print_time(local_time);
-	print_time(other_time);
-	print_time(back_time);
+	static char out_buf[1024 * 1024];
+	setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
 
-	TZ_Time utc_now = tz_time_from_unix_seconds(time(NULL));
-	print_time(tz_time_to_tz(utc_now, local_region));
+	Stats stats = {0};
+	double start = clock_seconds();
+	bool ok = process_input(&opts, pool, chunks, max_chunks, &stats);
+	if (fflush(stdout) != 0) {
+		ok = false;
+	}
+	double elapsed = clock_seconds() - start;
 
-	tz_region_destroy(local_region);
-	tz_region_destroy(other_region);
+	if (opts.stats) {
+		double secs = (elapsed > 0) ? elapsed : 1e-9;
+		fprintf(stderr,
+			"lines:     %lld (%lld converted)\n"
+			"bytes:     %lld\n"
+			"elapsed:   %.3f s\n"
+			"lines/s:   %.0f\n"
+			"MiB/s:     %.1f\n",
+			(long long)stats.lines, (long long)stats.converted,
+			(long long)stats.bytes,
+			elapsed,
+			(double)stats.lines / secs,
+			((double)stats.bytes / (1024.0 * 1024.0)) / secs
+		);
+	}
 
+	for (int64_t i = 0; i < max_chunks; i++) {
+		free(chunks[i].out.data);
+	}
+	free(chunks);
+	tz_pool_destroy(pool);
+	free_zone(opts.from);
+	free_zone(opts.to);
+
+	if (!ok) {
+		fprintf(stderr, "Conversion failed!\n");
+		return 1;
+	}
 	return 0;
 }